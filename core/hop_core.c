@@ -0,0 +1,471 @@
+// Entry points of the core library (hop_core.h) over the native routines of the package.
+//
+// Each entry point checks its arguments, takes the workspace of the caller as the stack behind
+// R_alloc (see hop_standalone.h), and calls the same routines as the .Call interface of the package.
+// error() in those routines longjmps back to the entry point, which then returns the status, so
+// that nothing is left allocated (the workspace belongs to the caller).
+
+#include "hop_core.h"
+#include "highOrderPortfolios.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HOP_ALIGN 64     // alignment of every allocation from the workspace (cache line)
+#define HOP_NALLOC 128   // bound on the number of allocations alive at the same time in any call
+
+// state of the current call, per thread
+typedef struct {
+  char *base;
+  size_t size, used, peak;
+  int active, status;
+  jmp_buf env;
+  char msg[256];
+} hop_context;
+
+static _Thread_local hop_context ctx;
+
+static void hop_vmessage(const char *fmt, va_list ap) {
+  vsnprintf(ctx.msg, sizeof(ctx.msg), fmt, ap);
+}
+
+static int hop_fail(int status, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  hop_vmessage(fmt, ap);
+  va_end(ap);
+  return status;
+}
+
+static void hop_raise(int status) __attribute__((noreturn));
+
+static void hop_raise(int status) {
+  if (!ctx.active) abort();  // only reachable from the routines called by an entry point
+  ctx.status = status;
+  longjmp(ctx.env, 1);
+}
+
+void hop_core_error(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  hop_vmessage(fmt, ap);
+  va_end(ap);
+  hop_raise(HOP_ERR_FAILED);
+}
+
+void hop_core_warning(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  hop_vmessage(fmt, ap);
+  va_end(ap);
+}
+
+void *hop_stack_alloc(size_t n, size_t size) {
+  uintptr_t start = ((uintptr_t)(ctx.base + ctx.used) + (HOP_ALIGN - 1)) & ~(uintptr_t)(HOP_ALIGN - 1);
+  size_t offset = (size_t)(start - (uintptr_t)ctx.base);
+  if (size != 0 && n > (SIZE_MAX - HOP_ALIGN) / size) hop_raise(HOP_ERR_WORKSPACE);
+  size_t bytes = n * size;
+  if (offset > ctx.size || bytes > ctx.size - offset) {
+    snprintf(ctx.msg, sizeof(ctx.msg), "workspace too small (%zu bytes more needed).", offset + bytes - ctx.size);
+    hop_raise(HOP_ERR_WORKSPACE);
+  }
+  ctx.used = offset + bytes;
+  if (ctx.used > ctx.peak) ctx.peak = ctx.used;
+  return ctx.base + offset;
+}
+
+void *hop_stack_mark(void) {
+  return ctx.base + ctx.used;
+}
+
+void hop_stack_release(void *mark) {
+  ctx.used = (size_t)((char *) mark - ctx.base);
+}
+
+static void hop_enter(void *work, size_t work_size) {
+  ctx.base = (char *) work;
+  ctx.size = work ? work_size : 0;
+  ctx.used = ctx.peak = 0;
+  ctx.active = 1;
+  ctx.status = HOP_OK;
+}
+
+static int hop_leave(void) {
+  ctx.active = 0;
+  return ctx.status;
+}
+
+// to be used at the start of an entry point, after checking the arguments: the routines called after
+// it return there on error, and the entry point returns the status
+#define HOP_ENTER(work, work_size)           \
+  hop_enter(work, work_size);                \
+  if (setjmp(ctx.env) != 0) return hop_leave()
+
+// bytes of workspace for the given number of doubles spread over at most HOP_NALLOC allocations
+static size_t hop_work_bytes(double ndoubles) {
+  return (size_t)(ndoubles * sizeof(double)) + (HOP_NALLOC + 1) * HOP_ALIGN;
+}
+
+const char *hop_core_version(void) {
+#define HOP_STR2(x) #x
+#define HOP_STR(x) HOP_STR2(x)
+  return HOP_STR(HOP_CORE_VERSION_MAJOR) "." HOP_STR(HOP_CORE_VERSION_MINOR);
+}
+
+const char *hop_error_message(void) {
+  return ctx.msg;
+}
+
+size_t hop_workspace_used(void) {
+  return ctx.peak;
+}
+
+size_t hop_packed_size(int N, int order) {
+  switch (order) {
+  case 2: return (size_t) n_unique2(N);
+  case 3: return (size_t) n_unique3(N);
+  case 4: return (size_t) n_unique4(N);
+  default: return 0;
+  }
+}
+
+
+// ---- sorting, as in R (R_rsort and rsort_with_index of R's sort.c, with NaNs last) --------------
+
+static int rcmp(double x, double y) {
+  int nax = ISNAN(x), nay = ISNAN(y);
+  if (nax && nay) return 0;
+  if (nax) return 1;
+  if (nay) return -1;
+  if (x < y) return -1;
+  if (x > y) return 1;
+  return 0;
+}
+
+void R_rsort(double *x, int n) {
+  int i, j, h;
+  for (h = 1; h <= n / 9; h = 3 * h + 1);
+  for (; h > 0; h /= 3)
+    for (i = h; i < n; i++) {
+      double v = x[i];
+      j = i;
+      while (j >= h && rcmp(x[j - h], v) > 0) {
+        x[j] = x[j - h];
+        j -= h;
+      }
+      x[j] = v;
+    }
+}
+
+void rsort_with_index(double *x, int *indx, int n) {
+  int i, j, h;
+  for (h = 1; h <= n / 9; h = 3 * h + 1);
+  for (; h > 0; h /= 3)
+    for (i = h; i < n; i++) {
+      double v = x[i];
+      int iv = indx[i];
+      j = i;
+      while (j >= h && rcmp(x[j - h], v) > 0) {
+        x[j] = x[j - h];
+        indx[j] = indx[j - h];
+        j -= h;
+      }
+      x[j] = v;
+      indx[j] = iv;
+    }
+}
+
+
+// ---- estimation of the sample co-moments --------------------------------------------------------
+
+size_t hop_comoments_sample_work(int T, int N, int nthreads) {
+  if (T < 1 || N < 1) return hop_work_bytes(0);
+  int TB = (int)(32768 / N);
+  if (TB < 16) TB = 16;
+  if (TB > T) TB = T;
+  return hop_work_bytes((double)T * N + 2.0 * TB * hop_num_threads(nthreads));
+}
+
+int hop_comoments_sample(const double *X, int T, int N, int nthreads, double *mu, double *Sgm, double *Phi,
+                         double *Psi, void *work, size_t work_size) {
+  if (!X || !mu || !Sgm || !Phi || !Psi || N < 1) return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  if (T < 2) return hop_fail(HOP_ERR_ARG, "at least two observations are needed.");
+  HOP_ENTER(work, work_size);
+  comoments_sample(X, T, N, hop_num_threads(nthreads), mu, Sgm, Phi, Psi);
+  return hop_leave();
+}
+
+
+// ---- portfolio moments and their gradients ------------------------------------------------------
+
+static hop_comoment hop_packed(const double *x, int order) {
+  hop_comoment X;
+  memset(&X, 0, sizeof(X));
+  X.kind = HOP_PACKED;
+  X.order = order;
+  X.x = x;
+  return X;
+}
+
+static int sample_moments_ok(const hop_sample_moments *m) {
+  return m && m->N >= 1 && m->mu && m->Sgm && m->Phi && m->Psi;
+}
+
+static int skewt_params_ok(const hop_skewt_params *p) {
+  return p && p->N >= 1 && p->mu && p->gamma && p->scatter && p->a;
+}
+
+size_t hop_port_moments_work(int N, int nthreads) {
+  return hop_work_bytes((2.0 + hop_num_threads(nthreads)) * (N > 0 ? N : 0));
+}
+
+int hop_port_moments(const hop_sample_moments *m, const double *w, int nthreads, double *moments, double *jac,
+                     void *work, size_t work_size) {
+  if (!sample_moments_ok(m) || !w || !moments) return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  HOP_ENTER(work, work_size);
+  int N = m->N, nth = hop_num_threads(nthreads);
+  hop_comoment Phi = hop_packed(m->Phi, 3), Psi = hop_packed(m->Psi, 4);
+  double *g = jac ? (double *) R_alloc(N, sizeof(double)) : NULL;
+
+  double m1 = 0.0, m2 = 0.0;
+  for (int i = 0; i < N; i++) {
+    double s = 0.0;
+    for (int j = 0; j < N; j++) s += m->Sgm[(R_xlen_t)j * N + i] * w[j];
+    m1 += m->mu[i] * w[i];
+    m2 += s * w[i];
+    if (jac) {
+      jac[4 * (R_xlen_t)i] = m->mu[i];
+      jac[4 * (R_xlen_t)i + 1] = 2 * s;
+    }
+  }
+  moments[0] = m1;
+  moments[1] = m2;
+  for (int r = 2; r < 4; r++) {
+    moments[r] = hop_port_kernel(r == 2 ? &Phi : &Psi, w, N, nth, g);
+    if (jac)
+      for (int i = 0; i < N; i++) jac[4 * (R_xlen_t)i + r] = g[i];
+  }
+  return hop_leave();
+}
+
+size_t hop_skewt_moments_work(int N) {
+  return hop_work_bytes(5.0 * (N > 0 ? N : 0));
+}
+
+int hop_skewt_moments(const hop_skewt_params *p, const double *w, double *moments, double *jac, void *work,
+                      size_t work_size) {
+  if (!skewt_params_ok(p) || !w || !moments) return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  HOP_ENTER(work, work_size);
+  skewt_model m = {p->N, p->mu, p->gamma, p->scatter, p->a};
+  static const double lmd[4] = {1.0, 1.0, 1.0, 1.0};
+  double *u = (double *) R_alloc(p->N, sizeof(double));
+  double *J = jac ? jac : (double *) R_alloc(4 * (size_t)p->N, sizeof(double));
+  skewt_moments(&m, w, lmd, moments, J, NULL, u, NULL);
+  return hop_leave();
+}
+
+int hop_skewt_bounds(const hop_skewt_params *p, int nthreads, double *b) {
+  if (!p || p->N < 1 || !p->gamma || !p->scatter || !p->a || !b) return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  HOP_ENTER(NULL, 0);
+  skewt_model m = {p->N, p->mu, p->gamma, p->scatter, p->a};
+  skewt_hess_bounds(&m, hop_num_threads(nthreads), b);
+  return hop_leave();
+}
+
+
+// ---- MVSK portfolio design ----------------------------------------------------------------------
+
+void hop_mvsk_options_init(hop_mvsk_options *opt) {
+  opt->method = HOP_QMVSK;
+  opt->maxiter = 100;
+  opt->nthreads = 0;
+  opt->tau_w = 0.0;
+  opt->gamma = 1.0;
+  opt->zeta = 1e-8;
+  opt->rho = -1.0;
+  opt->ftol = 1e-5;
+  opt->wtol = 1e-4;
+  opt->stopval = -INFINITY;
+  opt->leverage = 1.0;
+  opt->maxtime = INFINITY;
+}
+
+static int mvsk_options_ok(const hop_mvsk_options *opt) {
+  return opt && opt->maxiter >= 1 && opt->leverage >= 1.0 && !ISNAN(opt->ftol) && !ISNAN(opt->wtol) &&
+    !ISNAN(opt->maxtime);
+}
+
+// trace of the iterations: the arrays of the caller, or from the workspace
+static sca_trace hop_trace(int N, int maxiter, hop_mvsk_result *res) {
+  sca_trace tr;
+  tr.iterations = tr.timed_out = 0;
+  tr.cpu_time = res->cpu_time ? res->cpu_time : (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.objs = res->objs ? res->objs : (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.prof = NULL;
+  tr.jac = (double *) R_alloc(4 * (size_t)N, sizeof(double));
+  return tr;
+}
+
+static void hop_result(const sca_trace *tr, int maxiter, double scale, hop_mvsk_result *res) {
+  res->iterations = tr->iterations;
+  res->timed_out = tr->timed_out;
+  res->converged = !(tr->iterations == maxiter || tr->timed_out);
+  for (int k = 0; k <= tr->iterations; k++) tr->objs[k] *= scale;
+  res->objective = tr->objs[tr->iterations];
+}
+
+size_t hop_mvsk_sample_work(int N, const hop_mvsk_options *opt) {
+  if (!opt || N < 1) return hop_work_bytes(0);
+  double n = N, nth = hop_num_threads(opt->nthreads), trace = 2.0 * ((double)opt->maxiter + 1);
+  // QP (2 N x N), Hessian bounds (nthreads N x N, before the loop), the loop (one N x N, and H34 for
+  // Q-MVSK), its evaluations (nthreads + 1 N x N for the Hessians of Q-MVSK), and the PSD approximation
+  // (2 N x N kept, at most 50 N x N and the LAPACK workspaces in each call)
+  if (opt->method == HOP_QMVSK)
+    return hop_work_bytes((6.0 + (nth + 1 > 50 ? nth + 1 : 50)) * n * n + 600.0 * n + trace);
+  return hop_work_bytes((3.0 + nth) * n * n + 64.0 * n + trace);
+}
+
+int hop_mvsk_sample(const hop_sample_moments *m, const double *lmd, const hop_mvsk_options *opt, double *w,
+                    hop_mvsk_result *res, void *work, size_t work_size) {
+  if (!sample_moments_ok(m) || !lmd || !w || !res || !mvsk_options_ok(opt))
+    return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  if (opt->method != HOP_QMVSK && opt->method != HOP_MM && opt->method != HOP_DC)
+    return hop_fail(HOP_ERR_ARG, "the method should be HOP_QMVSK, HOP_MM, or HOP_DC for the sample moments.");
+  HOP_ENTER(work, work_size);
+  int N = m->N, nth = hop_num_threads(opt->nthreads);
+  hop_comoment Phi = hop_packed(m->Phi, 3), Psi = hop_packed(m->Psi, 4);
+  sca_options o = {opt->method, opt->maxiter, nth, opt->tau_w, opt->gamma, opt->zeta, opt->rho, opt->ftol, opt->wtol,
+                   opt->stopval, opt->leverage, opt->maxtime};
+  if (opt->method != HOP_QMVSK) {
+    o.gamma = 1.0;
+    o.zeta = 0.0;
+    if (o.rho < 0) {  // as design_MVSK_portfolio_via_sample_moments()
+      const void *vmax = vmaxget();
+      int use_max = opt->method == HOP_MM;
+      double S = 6 * hop_hess_bound(&Phi, N, use_max, nth), K = 12 * hop_hess_bound(&Psi, N, use_max, nth);
+      o.rho = opt->leverage * lmd[2] * S + opt->leverage * opt->leverage * lmd[3] * K;
+      vmaxset(vmax);
+    }
+  } else
+    o.rho = 0.0;
+
+  simplex_qp *qp = sqp_alloc(N);
+  psd_tracker *psd = opt->method == HOP_QMVSK ? psd_alloc(N) : NULL;
+  sca_trace tr = hop_trace(N, opt->maxiter, res);
+  sca_run(lmd, m->mu, m->Sgm, &Phi, &Psi, N, &o, qp, psd, w, &tr);
+
+  hop_result(&tr, opt->maxiter, 1.0, res);
+  for (int r = 0; r < 4; r++) {  // as.vector(jac %*% w) / c(1, 2, 3, 4)
+    double s = 0.0;
+    for (int i = 0; i < N; i++) s += tr.jac[(R_xlen_t)r * N + i] * w[i];
+    res->moments[r] = s / (r + 1);
+  }
+  return hop_leave();
+}
+
+size_t hop_mvsk_skewt_work(int N, const hop_mvsk_options *opt) {
+  if (!opt || N < 1) return hop_work_bytes(0);
+  double n = N;
+  return hop_work_bytes(3.0 * n * n + 64.0 * n + 2.0 * ((double)opt->maxiter + 1));
+}
+
+int hop_mvsk_skewt(const hop_skewt_params *p, const double *lmd, const hop_mvsk_options *opt, double *w,
+                   hop_mvsk_result *res, void *work, size_t work_size) {
+  if (!skewt_params_ok(p) || !lmd || !w || !res || !mvsk_options_ok(opt))
+    return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  if (opt->method != HOP_LMVSK && opt->method != HOP_DC)
+    return hop_fail(HOP_ERR_ARG, "the method should be HOP_LMVSK or HOP_DC for the skew-t model.");
+  if (opt->leverage != 1.0) return hop_fail(HOP_ERR_ARG, "the skew-t model does not support leverage.");
+  HOP_ENTER(work, work_size);
+  int N = p->N, nth = hop_num_threads(opt->nthreads);
+  skewt_model m = {N, p->mu, p->gamma, p->scatter, p->a};
+
+  // as design_MVSK_portfolio_via_skew_t(): the weights are normalized by their maximum
+  double lmd_max = lmd[0], lambda[4];
+  for (int r = 1; r < 4; r++) lmd_max = lmd[r] > lmd_max ? lmd[r] : lmd_max;
+  for (int r = 0; r < 4; r++) lambda[r] = lmd[r] / lmd_max;
+  sca_options o = {opt->method == HOP_LMVSK ? SKEWT_LMVSK : SKEWT_DC, opt->maxiter, nth, 0.0, 1.0, 0.0, opt->rho,
+                   opt->ftol, opt->wtol, opt->stopval, 1.0, opt->maxtime};
+  if (o.rho < 0) {
+    double b[3];
+    skewt_hess_bounds(&m, nth, b);
+    o.rho = (opt->method == HOP_LMVSK) ? lambda[2] * b[1] + lambda[3] * b[2] :
+      lambda[1] * b[0] + lambda[2] * b[1] + lambda[3] * b[2];
+  }
+
+  simplex_qp *qp = sqp_alloc(N);
+  sca_trace tr = hop_trace(N, opt->maxiter, res);
+  skewt_sca_run(&m, lambda, &o, qp, w, &tr);
+
+  hop_result(&tr, opt->maxiter, lmd_max, res);
+  double *u = (double *) R_alloc(N, sizeof(double));
+  skewt_moments(&m, w, lambda, res->moments, tr.jac, NULL, u, NULL);
+  return hop_leave();
+}
+
+
+// ---- MVSK tilting -------------------------------------------------------------------------------
+
+void hop_tilting_options_init(hop_tilting_options *opt) {
+  opt->maxiter = 100;
+  opt->nthreads = 0;
+  opt->kappa = 0.0;
+  opt->leverage = 1.0;
+  opt->tau_w = 1e-5;
+  opt->tau_delta = 1e-5;
+  opt->gamma = 1.0;
+  opt->zeta = 1e-8;
+  opt->theta = 0.5;
+  opt->ftol = 1e-5;
+  opt->wtol = 1e-5;
+  opt->stopval = -INFINITY;
+}
+
+size_t hop_tilting_sample_work(int N, const hop_tilting_options *opt) {
+  if (!opt || N < 1) return hop_work_bytes(0);
+  // the loop (about 40 N for the rows, the LP, and the QP over the signed split), the gradients of the
+  // moments (nthreads N of them per call), and the trace
+  return hop_work_bytes((64.0 + hop_num_threads(opt->nthreads)) * N + 64.0 + 2.0 * ((double)opt->maxiter + 1));
+}
+
+int hop_tilting_sample(const hop_sample_moments *m, const double *d, const double *w0, const double *w0_moments,
+                       const hop_tilting_options *opt, double *w, hop_tilting_result *res, void *work,
+                       size_t work_size) {
+  if (!sample_moments_ok(m) || !d || !w0 || !w || !res || !opt || opt->maxiter < 1 || !(opt->leverage >= 1.0) ||
+      !(opt->kappa >= 0.0) || ISNAN(opt->ftol) || ISNAN(opt->wtol))
+    return hop_fail(HOP_ERR_ARG, "invalid arguments.");
+  if (!(opt->tau_w > 0) || !(opt->tau_delta > 0)) return hop_fail(HOP_ERR_ARG, "tau_w and tau_delta should be positive.");
+  HOP_ENTER(work, work_size);
+  int N = m->N, nth = hop_num_threads(opt->nthreads);
+  hop_comoment Phi = hop_packed(m->Phi, 3), Psi = hop_packed(m->Psi, 4);
+
+  double mom0[4];
+  if (!w0_moments) {  // as eval_portfolio_moments()
+    mom0[0] = mom0[1] = 0.0;
+    for (int i = 0; i < N; i++) {
+      double s = 0.0;
+      for (int j = 0; j < N; j++) s += m->Sgm[(R_xlen_t)j * N + i] * w0[j];
+      mom0[0] += m->mu[i] * w0[i];
+      mom0[1] += s * w0[i];
+    }
+    mom0[2] = hop_port_kernel(&Phi, w0, N, nth, NULL);
+    mom0[3] = hop_port_kernel(&Psi, w0, N, nth, NULL);
+    w0_moments = mom0;
+  }
+
+  tilt_options o = {opt->maxiter, nth, opt->leverage, opt->kappa, opt->tau_w, opt->tau_delta, opt->gamma, opt->zeta,
+                    opt->theta, opt->ftol, opt->wtol, opt->stopval};
+  tilt_trace tr;
+  memset(&tr, 0, sizeof(tr));
+  tr.cpu_time = res->cpu_time ? res->cpu_time : (double *) R_alloc((size_t)opt->maxiter + 1, sizeof(double));
+  tr.objs = res->objs ? res->objs : (double *) R_alloc((size_t)opt->maxiter + 1, sizeof(double));
+  tilt_run(d, m->mu, m->Sgm, &Phi, &Psi, N, w0, w0_moments, &o, w, &tr);
+
+  res->iterations = tr.iterations;
+  res->converged = tr.iterations != opt->maxiter;
+  res->objective = tr.objs[tr.iterations];
+  res->delta = tr.delta;
+  memcpy(res->moments, tr.moments, sizeof(res->moments));
+  return hop_leave();
+}
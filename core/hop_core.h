@@ -0,0 +1,171 @@
+// Core library of highOrderPortfolios: the native routines of the package, usable without R.
+//
+// Conventions of the whole API:
+//   - matrices are column-major (as in R and Fortran), and the co-skewness and co-kurtosis are
+//     packed, i.e., only their unique elements are stored, in the order of the package (see
+//     src/highOrderPortfolios.h): N(N+1)(N+2)/6 and N(N+1)(N+2)(N+3)/24 doubles, hop_packed_size();
+//   - the gradients of the four moments are returned as a 4 x N matrix: jac[4*i + r] is the
+//     derivative of moment r (mean, variance, skewness, kurtosis) with respect to w[i];
+//   - nothing is allocated: every function writes its results into the arrays passed by the caller
+//     and takes its scratch memory from the workspace (work, work_size in bytes), whose required
+//     size is given by the matching *_work() function (a bound, independent of the data). The same
+//     workspace can be reused by successive calls, but not by concurrent ones;
+//   - nthreads is the number of OpenMP threads (a non-positive value means the OpenMP default);
+//   - every function but the *_work() ones returns HOP_OK or an error status, with the message
+//     available from hop_error_message() in the same thread (which also keeps the last warning,
+//     e.g., when a QP subproblem did not converge). The library keeps no other state,
+//     so it can be called from several threads with different workspaces.
+//
+// The API follows the version below: within a major version, functions and structs are only
+// added, never changed (new fields of the option structs are set by hop_mvsk_options_init()).
+
+#ifndef HOP_CORE_H
+#define HOP_CORE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOP_CORE_VERSION_MAJOR 1
+#define HOP_CORE_VERSION_MINOR 1
+
+// status codes
+enum {
+  HOP_OK = 0,
+  HOP_ERR_ARG = 1,        // invalid argument (dimension, method, NULL pointer)
+  HOP_ERR_WORKSPACE = 2,  // workspace smaller than the size given by the *_work() function
+  HOP_ERR_FAILED = 3      // numerical failure (e.g., of an eigendecomposition)
+};
+
+// "major.minor" of the library and message of the last failed call in this thread
+const char *hop_core_version(void);
+const char *hop_error_message(void);
+
+// bytes of workspace actually used by the last call in this thread (at most the size given by the
+// matching *_work() function)
+size_t hop_workspace_used(void);
+
+// number of elements of the packed co-moment of the given order (2, 3, or 4) over N assets
+size_t hop_packed_size(int N, int order);
+
+
+// ---- estimation of the sample co-moments --------------------------------------------------------
+
+// sample mean (N), covariance (N x N, normalized by T - 1), and packed co-skewness and co-kurtosis
+// (normalized by T) of the T x N returns X, in one pass over the data
+size_t hop_comoments_sample_work(int T, int N, int nthreads);
+int hop_comoments_sample(const double *X, int T, int N, int nthreads, double *mu, double *Sgm, double *Phi,
+                         double *Psi, void *work, size_t work_size);
+
+
+// ---- portfolio moments and their gradients ------------------------------------------------------
+
+// sample moments of N assets: mean, covariance, and packed co-skewness and co-kurtosis
+typedef struct {
+  int N;
+  const double *mu, *Sgm, *Phi, *Psi;
+} hop_sample_moments;
+
+// skew-t model of N assets: location, skewness, scatter (N x N), and the coefficients of the
+// moments a = (a11, a21, a22, a31, a32, a41, a42, a43), as estimate_skew_t() in R
+typedef struct {
+  int N;
+  const double *mu, *gamma, *scatter, *a;
+} hop_skewt_params;
+
+// the four moments of the portfolio w (moments, 4) and, if jac is not NULL, their gradients (4 x N)
+size_t hop_port_moments_work(int N, int nthreads);
+int hop_port_moments(const hop_sample_moments *m, const double *w, int nthreads, double *moments, double *jac,
+                     void *work, size_t work_size);
+size_t hop_skewt_moments_work(int N);
+int hop_skewt_moments(const hop_skewt_params *p, const double *w, double *moments, double *jac, void *work,
+                      size_t work_size);
+
+// bounds (b2, b3, b4) on the Hessians of the variance, skewness, and kurtosis under the skew-t model,
+// as compute_skew_t_bounds() in R (no workspace needed)
+int hop_skewt_bounds(const hop_skewt_params *p, int nthreads, double *b);
+
+
+// ---- MVSK portfolio design ----------------------------------------------------------------------
+
+// minimize - lmd1*mean + lmd2*variance - lmd3*skewness + lmd4*kurtosis over the portfolios w with
+// sum(w) == 1 and sum(|w|) <= leverage (w >= 0 when leverage is 1), by successive convex approximation:
+// HOP_QMVSK, HOP_MM, and HOP_DC for the sample moments (as design_MVSK_portfolio_via_sample_moments()
+// in R), and HOP_LMVSK and HOP_DC for the skew-t model (as design_MVSK_portfolio_via_skew_t(), which
+// does not support leverage)
+enum { HOP_QMVSK = 0, HOP_MM = 1, HOP_DC = 2, HOP_LMVSK = 3 };
+
+typedef struct {
+  int method, maxiter, nthreads;
+  double tau_w, gamma, zeta;  // HOP_QMVSK: strong convexity term and step sizes
+  double rho;                 // HOP_MM, HOP_DC, HOP_LMVSK: if negative, from the Hessian bounds (as in R)
+  double ftol, wtol, stopval; // stopping criteria, as in R
+  double leverage;            // sample moments only
+  double maxtime;             // budget in seconds of elapsed time (infinite for none)
+} hop_mvsk_options;
+
+// the defaults of the R functions for the sample moments (for the skew-t model, R uses maxiter = 1000,
+// ftol = wtol = 1e-6)
+void hop_mvsk_options_init(hop_mvsk_options *opt);
+
+typedef struct {
+  int iterations;       // number of iterations done
+  int converged;        // whether a stopping criterion was met (not maxiter nor maxtime)
+  int timed_out;        // whether it stopped at maxtime
+  double objective;     // objective at the solution
+  double moments[4];    // moments of the solution
+  double *objs;         // if not NULL, maxiter + 1 elements: objective over the iterations
+  double *cpu_time;     // if not NULL, maxiter + 1 elements: elapsed time over the iterations
+} hop_mvsk_result;
+
+// w: on input the initial portfolio, on output the solution
+size_t hop_mvsk_sample_work(int N, const hop_mvsk_options *opt);
+int hop_mvsk_sample(const hop_sample_moments *m, const double *lmd, const hop_mvsk_options *opt, double *w,
+                    hop_mvsk_result *res, void *work, size_t work_size);
+size_t hop_mvsk_skewt_work(int N, const hop_mvsk_options *opt);
+int hop_mvsk_skewt(const hop_skewt_params *p, const double *lmd, const hop_mvsk_options *opt, double *w,
+                   hop_mvsk_result *res, void *work, size_t work_size);
+
+
+// ---- MVSK tilting -------------------------------------------------------------------------------
+
+// tilt the reference portfolio w0 towards the MVSK efficient frontier: maximize delta such that the mean
+// and skewness of w exceed those of w0 by at least delta*d[0] and delta*d[2], and its variance and kurtosis
+// are below by at least delta*d[1] and delta*d[3], with the tracking error (w-w0)'Sgm(w-w0) <= kappa^2,
+// sum(w) == 1, and sum(|w|) <= leverage (w >= 0 when leverage is 1), by the L-MVSKT method (as
+// design_MVSKtilting_portfolio_via_sample_moments(method = "L-MVSKT", engine = "native") in R)
+typedef struct {
+  int maxiter, nthreads;
+  double kappa, leverage;
+  double tau_w, tau_delta;    // strong convexity terms (> 0)
+  double gamma, zeta, theta;  // step sizes, and combination coefficient of the enlarged feasible set
+  double ftol, wtol, stopval; // stopping criteria, as in R
+} hop_tilting_options;
+
+// the defaults of the R function (but kappa, which has no sensible default: 0 keeps w at w0)
+void hop_tilting_options_init(hop_tilting_options *opt);
+
+typedef struct {
+  int iterations;       // number of iterations done
+  int converged;        // whether a stopping criterion was met (not maxiter)
+  double objective;     // objective at the solution (the largest of the normalized losses of the moments)
+  double delta;         // tilting distance of the solution
+  double moments[4];    // moments of the solution
+  double *objs;         // if not NULL, maxiter + 1 elements: objective over the iterations
+  double *cpu_time;     // if not NULL, maxiter + 1 elements: elapsed time over the iterations
+} hop_tilting_result;
+
+// w: on input the initial portfolio, on output the solution; w0_moments: the moments of the reference
+// portfolio, computed from w0 if NULL
+size_t hop_tilting_sample_work(int N, const hop_tilting_options *opt);
+int hop_tilting_sample(const hop_sample_moments *m, const double *d, const double *w0, const double *w0_moments,
+                       const hop_tilting_options *opt, double *w, hop_tilting_result *res, void *work,
+                       size_t work_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
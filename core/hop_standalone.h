@@ -0,0 +1,86 @@
+// The subset of the R API used by the native routines of highOrderPortfolios, for building them
+// outside of R (with -DHOP_STANDALONE, see core/Makefile).
+//
+// The R interface of each source file (the .Call entry points, the external pointers, and the
+// conversion from SEXP) is left out of such builds; what remains only needs:
+//   - R_alloc/vmaxget/vmaxset: transient memory released at the end of the call. Here it comes
+//     from the workspace passed to the entry point of the core library (hop_core.c), which is
+//     used as a stack, so that no memory is allocated during a call. R_Calloc/R_Free (the QP and
+//     PSD workspaces) take from the same stack, and R_Free is a no-op.
+//   - error/warning: error() unwinds to the entry point (as in R) and makes it return the status
+//     HOP_ERR_FAILED with the message; warnings are only kept as the last message.
+//   - R_CheckUserInterrupt: nothing to do outside R.
+//   - R_rsort/rsort_with_index: the same sorts as in R (hop_core.c), so that ties are broken alike.
+//   - the BLAS and LAPACK routines, with the Fortran character-length arguments (FCONE).
+
+#ifndef HOP_STANDALONE_H
+#define HOP_STANDALONE_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef ptrdiff_t R_xlen_t;
+
+#define R_PosInf INFINITY
+#define R_NegInf (-INFINITY)
+#define R_NaN NAN
+#define ISNAN(x) isnan(x)
+#define R_FINITE(x) isfinite(x)
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+// workspace of the current call (hop_core.c)
+void *hop_stack_alloc(size_t n, size_t size);
+void *hop_stack_mark(void);
+void hop_stack_release(void *mark);
+void hop_core_error(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+void hop_core_warning(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#define R_alloc(n, size) ((char *) hop_stack_alloc((size_t)(n), (size_t)(size)))
+#define vmaxget() hop_stack_mark()
+#define vmaxset(mark) hop_stack_release((void *)(mark))
+#define R_Calloc(n, type) ((type *) memset(hop_stack_alloc((size_t)(n), sizeof(type)), 0, (size_t)(n) * sizeof(type)))
+#define R_Free(p) ((void)(p))
+#define error hop_core_error
+#define warning hop_core_warning
+#define R_CheckUserInterrupt() ((void)0)
+void R_rsort(double *x, int n);
+void rsort_with_index(double *x, int *indx, int n);
+
+// BLAS and LAPACK, with the hidden lengths of the character arguments
+#define F77_CALL(name) name ## _
+#define FCONE , (size_t)1
+
+double ddot_(const int *n, const double *dx, const int *incx, const double *dy, const int *incy);
+void dscal_(const int *n, const double *alpha, double *dx, const int *incx);
+void dgemv_(const char *trans, const int *m, const int *n, const double *alpha, const double *a, const int *lda,
+            const double *x, const int *incx, const double *beta, double *y, const int *incy, size_t);
+void dsymv_(const char *uplo, const int *n, const double *alpha, const double *a, const int *lda,
+            const double *x, const int *incx, const double *beta, double *y, const int *incy, size_t);
+void dgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k, const double *alpha,
+            const double *a, const int *lda, const double *b, const int *ldb, const double *beta, double *c,
+            const int *ldc, size_t, size_t);
+void dsymm_(const char *side, const char *uplo, const int *m, const int *n, const double *alpha, const double *a,
+            const int *lda, const double *b, const int *ldb, const double *beta, double *c, const int *ldc,
+            size_t, size_t);
+void dsyrk_(const char *uplo, const char *trans, const int *n, const int *k, const double *alpha, const double *a,
+            const int *lda, const double *beta, double *c, const int *ldc, size_t, size_t);
+void dsyr2k_(const char *uplo, const char *trans, const int *n, const int *k, const double *alpha, const double *a,
+             const int *lda, const double *b, const int *ldb, const double *beta, double *c, const int *ldc,
+             size_t, size_t);
+void dsyevr_(const char *jobz, const char *range, const char *uplo, const int *n, double *a, const int *lda,
+             const double *vl, const double *vu, const int *il, const int *iu, const double *abstol, int *m,
+             double *w, double *z, const int *ldz, int *isuppz, double *work, const int *lwork, int *iwork,
+             const int *liwork, int *info, size_t, size_t, size_t);
+void dsytrf_(const char *uplo, const int *n, double *a, const int *lda, int *ipiv, double *work, const int *lwork,
+             int *info, size_t);
+void dpstrf_(const char *uplo, const int *n, double *a, const int *lda, int *piv, int *rank, const double *tol,
+             double *work, int *info, size_t);
+void dsytrs_(const char *uplo, const int *n, const int *nrhs, const double *a, const int *lda, const int *ipiv,
+             double *b, const int *ldb, int *info, size_t);
+
+#endif
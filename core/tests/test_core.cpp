@@ -0,0 +1,471 @@
+// Tests of the core library (make check): the results of each entry point against direct
+// computations on small problems, and the handling of the workspace and of invalid arguments.
+
+#include "hop_core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+static int n_checks = 0, n_failed = 0;
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    n_checks++;                                                              \
+    if (!(cond)) {                                                           \
+      n_failed++;                                                            \
+      std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);   \
+    }                                                                        \
+  } while (0)
+
+#define CHECK_NEAR(a, b, tol) CHECK(std::fabs((a) - (b)) <= (tol) * (1.0 + std::fabs(b)))
+
+typedef std::vector<double> vec;
+
+// workspace sized by the *_work() function, checked against what the call actually used
+struct Workspace {
+  std::vector<unsigned char> buf;
+  explicit Workspace(size_t bytes) : buf(bytes) {}
+  void *data() { return buf.data(); }
+  size_t size() const { return buf.size(); }
+};
+
+// returns with skewness and heavy tails: T x N, column-major
+static vec simulate_returns(int T, int N, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<double> z(0.0, 1.0);
+  std::exponential_distribution<double> e(1.0);
+  vec X((size_t)T * N);
+  for (int t = 0; t < T; t++) {
+    double market = 0.01 * z(gen);
+    for (int i = 0; i < N; i++)
+      X[(size_t)i * T + t] = 0.001 * (i + 1) + market + 0.01 * z(gen) + 0.004 * (e(gen) - 1.0) * (i % 2 ? 1 : -1);
+  }
+  return X;
+}
+
+struct SampleMoments {
+  int N;
+  vec mu, Sgm, Phi, Psi;
+  hop_sample_moments view() const { return {N, mu.data(), Sgm.data(), Phi.data(), Psi.data()}; }
+};
+
+static SampleMoments estimate(const vec &X, int T, int N) {
+  SampleMoments m{N, vec(N), vec((size_t)N * N), vec(hop_packed_size(N, 3)), vec(hop_packed_size(N, 4))};
+  Workspace ws(hop_comoments_sample_work(T, N, 2));
+  int status = hop_comoments_sample(X.data(), T, N, 2, m.mu.data(), m.Sgm.data(), m.Phi.data(), m.Psi.data(),
+                                    ws.data(), ws.size());
+  CHECK(status == HOP_OK);
+  CHECK(hop_workspace_used() <= ws.size());
+  return m;
+}
+
+// the four moments of the returns of the portfolio, from the data
+static void direct_moments(const vec &X, int T, int N, const double *w, double *mom) {
+  vec r(T, 0.0);
+  for (int i = 0; i < N; i++)
+    for (int t = 0; t < T; t++) r[t] += X[(size_t)i * T + t] * w[i];
+  double mean = 0.0;
+  for (double v : r) mean += v;
+  mean /= T;
+  double s2 = 0.0, s3 = 0.0, s4 = 0.0;
+  for (double v : r) {
+    double c = v - mean;
+    s2 += c * c;
+    s3 += c * c * c;
+    s4 += c * c * c * c;
+  }
+  mom[0] = mean;
+  mom[1] = s2 / (T - 1);
+  mom[2] = s3 / T;
+  mom[3] = s4 / T;
+}
+
+static vec equal_weights(int N) { return vec(N, 1.0 / N); }
+
+static vec random_weights(int N, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::exponential_distribution<double> e(1.0);
+  vec w(N);
+  double s = 0.0;
+  for (double &v : w) s += (v = e(gen));
+  for (double &v : w) v /= s;
+  return w;
+}
+
+// gradients of the moments (4 x N) against central differences
+static void check_gradients(int N, const vec &w, const vec &jac, const std::function<void(const vec &, double *)> &moments) {
+  const double h = 1e-6;
+  for (int i = 0; i < N; i++) {
+    vec wp = w, wm = w;
+    wp[i] += h;
+    wm[i] -= h;
+    double mp[4], mm[4];
+    moments(wp, mp);
+    moments(wm, mm);
+    for (int r = 0; r < 4; r++) {
+      double fd = (mp[r] - mm[r]) / (2 * h);
+      CHECK(std::fabs(jac[4 * (size_t)i + r] - fd) <= 1e-5 * (1.0 + std::fabs(fd)));
+    }
+  }
+}
+
+static double mvsk_objective(const double *lmd, const double *mom) {
+  return - lmd[0] * mom[0] + lmd[1] * mom[1] - lmd[2] * mom[2] + lmd[3] * mom[3];
+}
+
+static bool on_simplex(const vec &w) {
+  double s = 0.0;
+  for (double v : w) {
+    if (v < -1e-10) return false;
+    s += v;
+  }
+  return std::fabs(s - 1.0) <= 1e-8;
+}
+
+static void test_comoments() {
+  const int T = 60, N = 5;
+  vec X = simulate_returns(T, N, 1);
+  SampleMoments m = estimate(X, T, N);
+
+  // every entry against the definition, centered at the sample mean
+  vec mu(N, 0.0);
+  for (int i = 0; i < N; i++) {
+    for (int t = 0; t < T; t++) mu[i] += X[(size_t)i * T + t];
+    mu[i] /= T;
+    CHECK_NEAR(m.mu[i], mu[i], 1e-12);
+  }
+  auto c = [&](int i, int t) { return X[(size_t)i * T + t] - mu[i]; };
+  size_t k3 = 0, k4 = 0;
+  for (int i = 0; i < N; i++)
+    for (int j = i; j < N; j++) {
+      double s2 = 0.0;
+      for (int t = 0; t < T; t++) s2 += c(i, t) * c(j, t);
+      CHECK_NEAR(m.Sgm[(size_t)j * N + i], s2 / (T - 1), 1e-12);
+      CHECK(m.Sgm[(size_t)j * N + i] == m.Sgm[(size_t)i * N + j]);
+      for (int k = j; k < N; k++) {
+        double s3 = 0.0;
+        for (int t = 0; t < T; t++) s3 += c(i, t) * c(j, t) * c(k, t);
+        CHECK_NEAR(m.Phi[k3++], s3 / T, 1e-12);
+        for (int l = k; l < N; l++) {
+          double s4 = 0.0;
+          for (int t = 0; t < T; t++) s4 += c(i, t) * c(j, t) * c(k, t) * c(l, t);
+          CHECK_NEAR(m.Psi[k4++], s4 / T, 1e-12);
+        }
+      }
+    }
+  CHECK(k3 == hop_packed_size(N, 3) && k4 == hop_packed_size(N, 4));
+}
+
+static void test_port_moments() {
+  const int T = 80, N = 6;
+  vec X = simulate_returns(T, N, 2);
+  SampleMoments m = estimate(X, T, N);
+  hop_sample_moments sm = m.view();
+  Workspace ws(hop_port_moments_work(N, 3));
+
+  auto moments = [&](const vec &w, double *mom) {
+    CHECK(hop_port_moments(&sm, w.data(), 3, mom, nullptr, ws.data(), ws.size()) == HOP_OK);
+  };
+  vec w = random_weights(N, 3), jac(4 * (size_t)N);
+  double mom[4], direct[4];
+  CHECK(hop_port_moments(&sm, w.data(), 3, mom, jac.data(), ws.data(), ws.size()) == HOP_OK);
+  CHECK(hop_workspace_used() <= ws.size());
+  direct_moments(X, T, N, w.data(), direct);
+  for (int r = 0; r < 4; r++) CHECK_NEAR(mom[r], direct[r], 1e-10);
+  check_gradients(N, w, jac, moments);
+}
+
+// skew-t model with nu degrees of freedom, coefficients as estimate_skew_t()
+struct SkewT {
+  int N;
+  vec mu, gamma, scatter, a;
+  hop_skewt_params view() const { return {N, mu.data(), gamma.data(), scatter.data(), a.data()}; }
+};
+
+static SkewT skewt_model(int N, double nu, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<double> z(0.0, 1.0);
+  SkewT p{N, vec(N), vec(N), vec((size_t)N * N, 0.0), vec(8)};
+  vec L((size_t)N * N);
+  for (double &v : L) v = 0.01 * z(gen);
+  for (int j = 0; j < N; j++)
+    for (int i = 0; i < N; i++) {
+      double s = (i == j) ? 1e-4 : 0.0;
+      for (int k = 0; k < N; k++) s += L[(size_t)k * N + i] * L[(size_t)k * N + j];
+      p.scatter[(size_t)j * N + i] = s;
+    }
+  for (int i = 0; i < N; i++) {
+    p.mu[i] = 0.001 * (i + 1);
+    p.gamma[i] = 0.002 * z(gen);
+  }
+  double n2 = nu - 2, n4 = nu - 4, n6 = nu - 6, n8 = nu - 8;
+  p.a = {nu / n2, nu / n2, 2 * nu * nu / (n2 * n2 * n4), 16 * nu * nu * nu / (n2 * n2 * n2 * n4 * n6),
+         6 * nu * nu / (n2 * n2 * n4), (12 * nu + 120) * std::pow(nu, 4) / (std::pow(n2, 4) * n4 * n6 * n8),
+         (2 * nu + 4) * nu * nu * nu / (n2 * n2 * n2 * n4 * n6) * 6, nu * nu / (n2 * n4) * 3};
+  return p;
+}
+
+static void test_skewt_moments() {
+  const int N = 7;
+  SkewT p = skewt_model(N, 10.0, 4);
+  hop_skewt_params sp = p.view();
+  Workspace ws(hop_skewt_moments_work(N));
+
+  auto moments = [&](const vec &w, double *mom) {
+    CHECK(hop_skewt_moments(&sp, w.data(), mom, nullptr, ws.data(), ws.size()) == HOP_OK);
+  };
+  vec w = random_weights(N, 5), jac(4 * (size_t)N);
+  double mom[4];
+  CHECK(hop_skewt_moments(&sp, w.data(), mom, jac.data(), ws.data(), ws.size()) == HOP_OK);
+  CHECK(hop_workspace_used() <= ws.size());
+
+  // moments from g = w'gamma and q = w'Sigma w
+  double g = 0.0, q = 0.0, m1 = 0.0;
+  for (int i = 0; i < N; i++) {
+    g += w[i] * p.gamma[i];
+    m1 += w[i] * p.mu[i];
+    for (int j = 0; j < N; j++) q += w[i] * p.scatter[(size_t)j * N + i] * w[j];
+  }
+  const vec &a = p.a;
+  CHECK_NEAR(mom[0], m1 + a[0] * g, 1e-12);
+  CHECK_NEAR(mom[1], a[1] * q + a[2] * g * g, 1e-12);
+  CHECK_NEAR(mom[2], a[3] * g * g * g + a[4] * g * q, 1e-12);
+  CHECK_NEAR(mom[3], a[5] * std::pow(g, 4) + a[6] * q * g * g + a[7] * q * q, 1e-12);
+  check_gradients(N, w, jac, moments);
+
+  // the bounds dominate the Hessian of the variance: b2 >= its largest eigenvalue >= e_i' H2 e_i
+  double b[3];
+  CHECK(hop_skewt_bounds(&sp, 2, b) == HOP_OK);
+  for (int i = 0; i < N; i++)
+    CHECK(b[0] >= 2 * (a[1] * p.scatter[(size_t)i * N + i] + a[2] * p.gamma[i] * p.gamma[i]) * (1 - 1e-12));
+  CHECK(b[1] > 0 && b[2] > 0);
+}
+
+static void test_mvsk_sample() {
+  const int T = 100, N = 8;
+  vec X = simulate_returns(T, N, 6);
+  SampleMoments m = estimate(X, T, N);
+  hop_sample_moments sm = m.view();
+  const double xi = 10, lmd[4] = {1, xi / 2, xi * (xi + 1) / 6, xi * (xi + 1) * (xi + 2) / 24};
+
+  double mom0[4];
+  vec w0 = equal_weights(N);
+  direct_moments(X, T, N, w0.data(), mom0);
+  double obj0 = mvsk_objective(lmd, mom0), obj_q = 0.0;
+
+  for (int method : {HOP_QMVSK, HOP_MM, HOP_DC}) {
+    hop_mvsk_options opt;
+    hop_mvsk_options_init(&opt);
+    opt.method = method;
+    opt.maxiter = 500;
+    Workspace ws(hop_mvsk_sample_work(N, &opt));
+    vec w = w0, objs(opt.maxiter + 1);
+    hop_mvsk_result res;
+    std::memset(&res, 0, sizeof(res));
+    res.objs = objs.data();
+    CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+    CHECK(hop_workspace_used() <= ws.size());
+    CHECK(on_simplex(w));
+    CHECK(res.iterations >= 1 && res.iterations <= opt.maxiter && !res.timed_out);
+
+    // the moments and objective of the solution, and a decrease from the start
+    double mom[4];
+    direct_moments(X, T, N, w.data(), mom);
+    for (int r = 0; r < 4; r++) CHECK_NEAR(res.moments[r], mom[r], 1e-8);
+    CHECK_NEAR(res.objective, mvsk_objective(lmd, mom), 1e-8);
+    CHECK_NEAR(objs[0], obj0, 1e-8);
+    CHECK(res.objective <= obj0);
+    if (method == HOP_QMVSK) obj_q = res.objective;
+    else CHECK(std::fabs(res.objective - obj_q) <= 1e-4 * std::fabs(obj_q));  // the same local minimum
+  }
+
+  // with leverage, on {sum(|w|) <= leverage, sum(w) == 1}, at least as good as without
+  hop_mvsk_options opt;
+  hop_mvsk_options_init(&opt);
+  opt.leverage = 1.5;
+  Workspace ws(hop_mvsk_sample_work(N, &opt));
+  vec w = w0;
+  hop_mvsk_result res;
+  std::memset(&res, 0, sizeof(res));
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+  double s = 0.0, l1 = 0.0;
+  for (double v : w) {
+    s += v;
+    l1 += std::fabs(v);
+  }
+  CHECK(std::fabs(s - 1.0) <= 1e-8 && l1 <= 1.5 + 1e-8);
+  CHECK(res.objective <= obj_q + 1e-4 * std::fabs(obj_q));
+
+  // a budget of no time stops after the first iteration
+  opt.leverage = 1.0;
+  opt.maxtime = 0.0;
+  w = w0;
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+  CHECK(res.iterations == 1 && res.timed_out && !res.converged);
+}
+
+static void test_mvsk_skewt() {
+  const int N = 10;
+  SkewT p = skewt_model(N, 12.0, 7);
+  hop_skewt_params sp = p.view();
+  const double lmd[4] = {1, 4, 10, 20};
+  vec w0 = equal_weights(N);
+  Workspace wm(hop_skewt_moments_work(N));
+  double mom0[4];
+  CHECK(hop_skewt_moments(&sp, w0.data(), mom0, nullptr, wm.data(), wm.size()) == HOP_OK);
+
+  double obj_l = 0.0;
+  for (int method : {HOP_LMVSK, HOP_DC}) {
+    hop_mvsk_options opt;
+    hop_mvsk_options_init(&opt);
+    opt.method = method;
+    opt.maxiter = 1000;
+    opt.ftol = opt.wtol = 1e-6;
+    Workspace ws(hop_mvsk_skewt_work(N, &opt));
+    vec w = w0, objs(opt.maxiter + 1);
+    hop_mvsk_result res;
+    std::memset(&res, 0, sizeof(res));
+    res.objs = objs.data();
+    CHECK(hop_mvsk_skewt(&sp, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+    CHECK(hop_workspace_used() <= ws.size());
+    CHECK(on_simplex(w));
+    CHECK(res.converged);
+
+    // objective in the original scale of lmd, non-increasing (majorization-minimization)
+    double mom[4];
+    CHECK(hop_skewt_moments(&sp, w.data(), mom, nullptr, wm.data(), wm.size()) == HOP_OK);
+    for (int r = 0; r < 4; r++) CHECK_NEAR(res.moments[r], mom[r], 1e-12);
+    CHECK_NEAR(res.objective, mvsk_objective(lmd, mom), 1e-10);
+    CHECK_NEAR(objs[0], mvsk_objective(lmd, mom0), 1e-10);
+    for (int k = 1; k <= res.iterations; k++) CHECK(objs[k] <= objs[k - 1] + 1e-12);
+    if (method == HOP_LMVSK) obj_l = res.objective;
+    else CHECK(std::fabs(res.objective - obj_l) <= 1e-4 * (1.0 + std::fabs(obj_l)));
+  }
+}
+
+static void test_tilting() {
+  const int T = 100, N = 8;
+  vec X = simulate_returns(T, N, 10);
+  SampleMoments m = estimate(X, T, N);
+  hop_sample_moments sm = m.view();
+
+  // as in the example of design_MVSKtilting_portfolio_via_sample_moments()
+  vec w0 = equal_weights(N);
+  double mom0[4], d[4], v0 = 0.0;
+  direct_moments(X, T, N, w0.data(), mom0);
+  for (int r = 0; r < 4; r++) d[r] = std::fabs(mom0[r]);
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++) v0 += w0[i] * m.Sgm[(size_t)j * N + i] * w0[j];
+  const double sgn[4] = {1, -1, 1, -1};
+
+  for (double leverage : {1.0, 1.5}) {
+    hop_tilting_options opt;
+    hop_tilting_options_init(&opt);
+    opt.kappa = 0.3 * std::sqrt(v0);
+    opt.leverage = leverage;
+    opt.zeta = 0.5;  // a diminishing step: the full one ends in a cycle on these returns
+    Workspace ws(hop_tilting_sample_work(N, &opt));
+    vec w = w0, objs(opt.maxiter + 1);
+    hop_tilting_result res;
+    std::memset(&res, 0, sizeof(res));
+    res.objs = objs.data();
+    CHECK(hop_tilting_sample(&sm, d, w0.data(), nullptr, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+    CHECK(hop_workspace_used() <= ws.size());
+    CHECK(res.iterations >= 1 && res.iterations <= opt.maxiter);
+
+    // feasible, and the moments and objective of the solution
+    double s = 0.0, l1 = 0.0;
+    for (int i = 0; i < N; i++) {
+      s += w[i];
+      l1 += std::fabs(w[i]);
+    }
+    CHECK(std::fabs(s - 1.0) <= 1e-8 && l1 <= leverage + 1e-8);
+    if (leverage == 1.0) CHECK(on_simplex(w));
+    double mom[4], obj = -INFINITY;
+    direct_moments(X, T, N, w.data(), mom);
+    for (int r = 0; r < 4; r++) {
+      CHECK_NEAR(res.moments[r], mom[r], 1e-8);
+      obj = std::max(obj, -(mom[r] - mom0[r]) / d[r] * sgn[r]);
+    }
+    CHECK_NEAR(res.objective, obj, 1e-8);
+    CHECK_NEAR(objs[0], 0.0, 1e-8);
+    CHECK(res.objective < 0 && res.delta > 0);  // every moment improves on those of w0
+
+    // the moments of w0 passed instead of computed
+    vec w2 = w0;
+    hop_tilting_result res2;
+    std::memset(&res2, 0, sizeof(res2));
+    CHECK(hop_tilting_sample(&sm, d, w0.data(), mom0, &opt, w2.data(), &res2, ws.data(), ws.size()) == HOP_OK);
+    CHECK(res2.iterations == res.iterations);
+    for (int i = 0; i < N; i++) CHECK_NEAR(w2[i], w[i], 1e-8);
+  }
+
+  // invalid arguments
+  hop_tilting_options opt;
+  hop_tilting_options_init(&opt);
+  opt.tau_w = 0.0;
+  vec w = w0;
+  hop_tilting_result res;
+  std::memset(&res, 0, sizeof(res));
+  Workspace ws(hop_tilting_sample_work(N, &opt));
+  CHECK(hop_tilting_sample(&sm, d, w0.data(), nullptr, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_ERR_ARG);
+  opt.tau_w = 1e-5;
+  opt.leverage = 0.5;
+  CHECK(hop_tilting_sample(&sm, d, w0.data(), nullptr, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_ERR_ARG);
+}
+
+static void test_errors() {
+  const int T = 30, N = 4;
+  vec X = simulate_returns(T, N, 8);
+  SampleMoments m = estimate(X, T, N);
+  hop_sample_moments sm = m.view();
+  const double lmd[4] = {1, 5, 18, 55};
+  hop_mvsk_options opt;
+  hop_mvsk_options_init(&opt);
+
+  // a workspace too small fails cleanly, and the next call with the right one works
+  vec w = equal_weights(N);
+  hop_mvsk_result res;
+  std::memset(&res, 0, sizeof(res));
+  Workspace small(256), ws(hop_mvsk_sample_work(N, &opt));
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, small.data(), small.size()) == HOP_ERR_WORKSPACE);
+  CHECK(std::strstr(hop_error_message(), "workspace") != nullptr);
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, nullptr, 0) == HOP_ERR_WORKSPACE);
+  w = equal_weights(N);
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+
+  // invalid arguments
+  opt.method = HOP_LMVSK;
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_ERR_ARG);
+  opt.method = HOP_MM;
+  opt.leverage = 0.5;
+  CHECK(hop_mvsk_sample(&sm, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_ERR_ARG);
+  double mom[4];
+  CHECK(hop_port_moments(nullptr, w.data(), 1, mom, nullptr, ws.data(), ws.size()) == HOP_ERR_ARG);
+  CHECK(hop_comoments_sample(X.data(), 1, N, 1, mom, mom, mom, mom, ws.data(), ws.size()) == HOP_ERR_ARG);
+  SkewT p = skewt_model(N, 10.0, 9);
+  hop_skewt_params sp = p.view();
+  opt.leverage = 1.0;
+  opt.method = HOP_DC;
+  CHECK(hop_mvsk_skewt(&sp, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_OK);
+  opt.method = HOP_QMVSK;
+  CHECK(hop_mvsk_skewt(&sp, lmd, &opt, w.data(), &res, ws.data(), ws.size()) == HOP_ERR_ARG);
+}
+
+int main() {
+  std::printf("highOrderPortfolios core library %s\n", hop_core_version());
+  test_comoments();
+  test_port_moments();
+  test_skewt_moments();
+  test_mvsk_sample();
+  test_mvsk_skewt();
+  test_tilting();
+  test_errors();
+  std::printf("%d checks, %d failed\n", n_checks, n_failed);
+  return n_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+// Co-skewness and co-kurtosis implied by a K-factor model of the returns, x = B f + e, with the
+// idiosyncratic terms e independent of the factors f and of each other.
+//
+// With v = B'w, the portfolio moments only involve the K x K (x K x K) co-moments of the factors,
+// their covariance Sf, and the variances s2 and third/fourth central moments sk of e:
+//   skewness   Phi_f(v, v, v) + sum_i sk_i w_i^3
+//   kurtosis   Psi_f(v, v, v, v) + 6 (v'Sf v)(w'D w) + 3 (w'D w)^2 + sum_i (sk_i - 3 s2_i^2) w_i^4,
+// with D = diag(s2), so they cost O(N*K) plus the packed kernels over K assets, and Phi*w
+// (Psi*(w x w)) is B [.] B' plus diagonal and rank-2 terms, O(N^2*K). With shrinkage toward the
+// model, the tensors are fcoef times the ones of the model plus coef times the sample ones, which
+// are implied by the centered returns as for HOP_LOWRANK (storage.c).
+//
+// In R, each tensor is a list with the loadings (N x K), the packed co-moment of the factors
+// ("factor"), their covariance ("factor_Sgm"), the idiosyncratic variances ("idio_var") and third
+// or fourth central moments ("idio"), and optionally the T x N centered returns ("Xc"), with
+// attribute "coef" = (coef, fcoef).
+
+#include "highOrderPortfolios.h"
+#ifndef HOP_STANDALONE
+#include <R_ext/BLAS.h>
+#endif
+#include <math.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+// conversion from the R objects (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+static SEXP list_elt(SEXP X, const char *name) {
+  SEXP names = getAttrib(X, R_NamesSymbol);
+  for (int i = 0; i < LENGTH(X); i++)
+    if (names != R_NilValue && strcmp(CHAR(STRING_ELT(names, i)), name) == 0) return VECTOR_ELT(X, i);
+  return R_NilValue;
+}
+
+hop_comoment factor_comoment_get(SEXP X, int order, int P) {
+  hop_comoment c = {.kind = HOP_FACTOR, .order = order};
+  SEXP B = list_elt(X, "loadings"), fx = list_elt(X, "factor"), Sf = list_elt(X, "factor_Sgm");
+  SEXP s2 = list_elt(X, "idio_var"), sk = list_elt(X, "idio"), Xc = list_elt(X, "Xc");
+  SEXP coef = getAttrib(X, install("coef"));
+
+  if (TYPEOF(B) != REALSXP || !isMatrix(B) || nrows(B) != P)
+    error("the factor co-moments should have a %d x K matrix of loadings.", P);
+  int K = ncols(B);
+  if (TYPEOF(fx) != REALSXP || XLENGTH(fx) != ((order == 3) ? n_unique3(K) : n_unique4(K)))
+    error("the packed co-moment of the factors does not correspond to %d factors.", K);
+  if (TYPEOF(Sf) != REALSXP || XLENGTH(Sf) != (R_xlen_t)K * K || TYPEOF(s2) != REALSXP || XLENGTH(s2) != P ||
+      TYPEOF(sk) != REALSXP || XLENGTH(sk) != P)
+    error("the factor co-moments should have the covariance of the factors and the moments of the %d residuals.", P);
+  if (TYPEOF(coef) != REALSXP || LENGTH(coef) != 2)
+    error("the factor co-moments should have attribute \"coef\" with the weights of the sample and factor parts.");
+  c.K = K;
+  c.B = REAL(B);
+  c.fx = REAL(fx);
+  c.Sf = REAL(Sf);
+  c.s2 = REAL(s2);
+  c.sk = REAL(sk);
+  c.coef = REAL(coef)[0];
+  c.fcoef = REAL(coef)[1];
+  if (Xc != R_NilValue) {
+    if (TYPEOF(Xc) != REALSXP || !isMatrix(Xc) || ncols(Xc) != P)
+      error("the sample part of the factor co-moments should be a T x %d matrix of centered returns.", P);
+    c.x = REAL(Xc);
+    c.T = nrows(Xc);
+  }
+  return c;
+}
+#endif
+
+// whether the co-moments include the sample part implied by the centered returns
+static inline int has_sample(const hop_comoment *X) { return X->T > 0 && X->coef != 0.0; }
+
+// v = B'w, and for the co-kurtosis Sv = Sf*v, a = v'Sf v, and q = w'D w
+static void factor_scores(const hop_comoment *X, const double *W, int P, double *v, double *Sv, double *a, double *q) {
+  int K = X->K, one = 1;
+  double done = 1.0, dzero = 0.0;
+  F77_CALL(dgemv)("T", &P, &K, &done, X->B, &P, W, &one, &dzero, v, &one FCONE);
+  if (X->order == 3) return;
+  F77_CALL(dgemv)("N", &K, &K, &done, X->Sf, &K, v, &one, &dzero, Sv, &one FCONE);
+  *a = 0.0;
+  for (int k = 0; k < K; k++) *a += v[k] * Sv[k];
+  *q = 0.0;
+  for (int i = 0; i < P; i++) *q += X->s2[i] * W[i] * W[i];
+}
+
+// portfolio skewness (kurtosis) and, if grad != NULL, its gradient
+double factor_port_kernel(const hop_comoment *X, const double *W, int P, double *grad) {
+  int K = X->K, one = 1;
+  double *v = (double *) R_alloc(3 * (size_t)K, sizeof(double)), *Sv = v + K, *gv = v + 2 * K;
+  double a = 0.0, q = 0.0, val;
+  factor_scores(X, W, P, v, Sv, &a, &q);
+
+  if (X->order == 3) {
+    val = M3port_kernel(X->fx, v, K, 1, grad ? gv : NULL);
+    for (int i = 0; i < P; i++) val += X->sk[i] * W[i] * W[i] * W[i];
+  } else {
+    val = M4port_kernel(X->fx, v, K, 1, grad ? gv : NULL) + 6 * a * q + 3 * q * q;
+    for (int i = 0; i < P; i++) {
+      double w2 = W[i] * W[i];
+      val += (X->sk[i] - 3 * X->s2[i] * X->s2[i]) * w2 * w2;
+    }
+    if (grad) for (int k = 0; k < K; k++) gv[k] += 12 * q * Sv[k];
+  }
+  val *= X->fcoef;
+
+  if (grad) {
+    double dzero = 0.0;
+    F77_CALL(dgemv)("N", &P, &K, &X->fcoef, X->B, &P, gv, &one, &dzero, grad, &one FCONE);
+    for (int i = 0; i < P; i++) {
+      double w = W[i];
+      grad[i] += X->fcoef * ((X->order == 3) ? 3 * X->sk[i] * w * w :
+                             12 * (a + q) * X->s2[i] * w + 4 * (X->sk[i] - 3 * X->s2[i] * X->s2[i]) * w * w * w);
+    }
+  }
+
+  if (has_sample(X)) {
+    double *g = grad ? (double *) R_alloc(P, sizeof(double)) : NULL;
+    val += lowrank_port_kernel(X, W, P, g);
+    if (grad) for (int i = 0; i < P; i++) grad[i] += g[i];
+  }
+  return val;
+}
+
+// H = Phi*w (Psi*(w x w)) as in M3port_hess_kernel (M4port_hess_kernel): for the co-kurtosis,
+// B (Psi_f*(v x v) + q Sf) B' + (a + q) D + 2 (u z' + z u' + z z') + diag((sk - 3 s2^2) w^2),
+// with u = B Sf v and z = D w
+void factor_port_hess_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *H) {
+  int K = X->K;
+  double *v = (double *) R_alloc(2 * (size_t)K, sizeof(double)), *Sv = v + K;
+  double *Hf = (double *) R_alloc((size_t)K * K, sizeof(double));
+  double *Y = (double *) R_alloc((size_t)P * K, sizeof(double));
+  double a = 0.0, q = 0.0, done = 1.0, dzero = 0.0, beta = 0.0;
+
+  if (has_sample(X)) {
+    lowrank_port_hess_kernel(X, W, P, nthreads, H);
+    beta = 1.0;
+  }
+  factor_scores(X, W, P, v, Sv, &a, &q);
+  if (X->order == 3)
+    M3port_hess_kernel(X->fx, v, K, 1, Hf);
+  else {
+    M4port_hess_kernel(X->fx, v, K, 1, Hf);
+    for (R_xlen_t k = 0; k < (R_xlen_t)K * K; k++) Hf[k] += q * X->Sf[k];
+  }
+  F77_CALL(dgemm)("N", "N", &P, &K, &K, &X->fcoef, X->B, &P, Hf, &K, &dzero, Y, &P FCONE FCONE);
+  F77_CALL(dgemm)("N", "T", &P, &P, &K, &done, Y, &P, X->B, &P, &beta, H, &P FCONE FCONE);
+
+  double c = X->fcoef;
+  if (X->order == 3) {
+    for (int i = 0; i < P; i++) H[(R_xlen_t)i * P + i] += c * X->sk[i] * W[i];
+    return;
+  }
+  double *u = (double *) R_alloc(2 * (size_t)P, sizeof(double)), *z = u + P;
+  int one = 1;
+  F77_CALL(dgemv)("N", &P, &K, &done, X->B, &P, Sv, &one, &dzero, u, &one FCONE);
+  for (int i = 0; i < P; i++) z[i] = X->s2[i] * W[i];
+  HOP_OMP(omp parallel for schedule(static) num_threads(nthreads))
+  for (int jj = 0; jj < P; jj++) {
+    double *hj = H + (R_xlen_t)jj * P;
+    for (int ii = 0; ii < P; ii++) hj[ii] += 2 * c * (u[ii] * z[jj] + z[ii] * u[jj] + z[ii] * z[jj]);
+    hj[jj] += c * ((a + q) * X->s2[jj] + (X->sk[jj] - 3 * X->s2[jj] * X->s2[jj]) * W[jj] * W[jj]);
+  }
+}
+
+
+// all K^order elements of a packed co-moment of K variables
+static double *unpack_full(const double *fx, int K, int order) {
+  R_xlen_t K2 = (R_xlen_t)K * K, n = (order == 3) ? K2 * K : K2 * K2;
+  double *F = (double *) R_alloc(n, sizeof(double));
+  for (R_xlen_t e = 0; e < n; e++) {
+    int idx[4], m = 0;
+    R_xlen_t r = e;
+    for (int p = 0; p < order; p++) { idx[p] = (int)(r % K); r /= K; }
+    // sort the indices (insertion sort of at most 4 elements)
+    for (int p = 1; p < order; p++)
+      for (int s = p; s > 0 && idx[s - 1] > idx[s]; s--) { m = idx[s]; idx[s] = idx[s - 1]; idx[s - 1] = m; }
+    F[e] = fx[(order == 3) ? M3_index(K, idx[0], idx[1], idx[2]) : M4_index(K, idx[0], idx[1], idx[2], idx[3])];
+  }
+  return F;
+}
+
+// unique elements (as in M3mat2vec/M4mat2vec) of the factor part of X, i.e., without the sample part;
+// the elements with first index ii are computed by one thread, contracting the co-moment of the
+// factors with one row of the loadings per index
+void factor_pack(const hop_comoment *X, int P, int nthreads, double *out) {
+  int K = X->K, order = X->order;
+  R_xlen_t K2 = (R_xlen_t)K * K;
+  const double *F = unpack_full(X->fx, K, order), *s2 = X->s2, *sk = X->sk;
+  double c = X->fcoef, done = 1.0, dzero = 0.0;
+
+  // rows of the loadings, and for the co-kurtosis C = B Sf B'
+  double *Bt = (double *) R_alloc((size_t)P * K, sizeof(double));
+  for (int ii = 0; ii < P; ii++)
+    for (int k = 0; k < K; k++) Bt[(R_xlen_t)ii * K + k] = X->B[(R_xlen_t)k * P + ii];
+  double *C = NULL;
+  if (order == 4) {
+    double *BS = (double *) R_alloc((size_t)P * K, sizeof(double));
+    C = (double *) R_alloc((size_t)P * P, sizeof(double));
+    F77_CALL(dgemm)("N", "N", &P, &K, &K, &done, X->B, &P, X->Sf, &K, &dzero, BS, &P FCONE FCONE);
+    F77_CALL(dgemm)("N", "T", &P, &P, &K, &done, BS, &P, X->B, &P, &dzero, C, &P FCONE FCONE);
+  }
+
+  // per thread: the contractions with the first one, two, and three indices
+  R_xlen_t nbuf = K2 * K + K2 + K;
+  double *buf = (double *) R_alloc(nbuf * nthreads, sizeof(double));
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *T1 = buf + nbuf * omp_get_thread_num();
+#else
+    double *T1 = buf;
+#endif
+    double *T2 = T1 + K2 * K, *u = T2 + K2;
+    const double *bi = Bt + (R_xlen_t)ii * K;
+    R_xlen_t m = (order == 3) ? K2 : K2 * K;  // elements of the contraction with the first index
+    for (R_xlen_t e = 0; e < m; e++) T1[e] = 0.0;
+    for (int k = 0; k < K; k++)
+      for (R_xlen_t e = 0; e < m; e++) T1[e] += bi[k] * F[(R_xlen_t)k + K * e];
+
+    if (order == 3) {
+      R_xlen_t idx = M3_index(P, ii, ii, ii);
+      for (int jj = ii; jj < P; jj++) {
+        const double *bj = Bt + (R_xlen_t)jj * K;
+        for (int d = 0; d < K; d++) {
+          double s = 0.0;
+          for (int k = 0; k < K; k++) s += bj[k] * T1[k + (R_xlen_t)K * d];
+          u[d] = s;
+        }
+        for (int kk = jj; kk < P; kk++) {
+          const double *bk = Bt + (R_xlen_t)kk * K;
+          double s = 0.0;
+          for (int d = 0; d < K; d++) s += bk[d] * u[d];
+          if (ii == kk) s += sk[ii];
+          out[idx++] = c * s;
+        }
+      }
+      continue;
+    }
+
+    R_xlen_t idx = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      const double *bj = Bt + (R_xlen_t)jj * K;
+      for (R_xlen_t e = 0; e < K2; e++) {
+        double s = 0.0;
+        for (int k = 0; k < K; k++) s += bj[k] * T1[k + K * e];
+        T2[e] = s;
+      }
+      for (int kk = jj; kk < P; kk++) {
+        const double *bk = Bt + (R_xlen_t)kk * K;
+        for (int d = 0; d < K; d++) {
+          double s = 0.0;
+          for (int k = 0; k < K; k++) s += bk[k] * T2[k + (R_xlen_t)K * d];
+          u[d] = s;
+        }
+        for (int ll = kk; ll < P; ll++) {
+          const double *bl = Bt + (R_xlen_t)ll * K;
+          double s = 0.0;
+          for (int d = 0; d < K; d++) s += bl[d] * u[d];
+          // covariance of the factor part times the idiosyncratic variances, over the 6 pairings
+          if (kk == ll) s += C[(R_xlen_t)jj * P + ii] * s2[kk];
+          if (jj == ll) s += C[(R_xlen_t)kk * P + ii] * s2[jj];
+          if (jj == kk) s += C[(R_xlen_t)ll * P + ii] * s2[jj];
+          if (ii == ll) s += C[(R_xlen_t)kk * P + jj] * s2[ii];
+          if (ii == kk) s += C[(R_xlen_t)ll * P + jj] * s2[ii];
+          if (ii == jj) s += C[(R_xlen_t)ll * P + kk] * s2[ii];
+          // fourth moment of the residuals
+          if (ii == jj && kk == ll) s += s2[ii] * s2[kk];
+          if (ii == kk && jj == ll) s += s2[ii] * s2[jj];
+          if (ii == ll && jj == kk) s += s2[ii] * s2[jj];
+          if (ii == ll) s += sk[ii] - 3 * s2[ii] * s2[ii];
+          out[idx++] = c * s;
+        }
+      }
+    }
+  }
+}
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+SEXP  factor_comoments_pack(SEXP XX, SEXP ORDER, SEXP PP, SEXP NTHREADS){
+  /*
+   arguments
+   XX        : co-skewness or co-kurtosis implied by a factor model (list, see factor_comoment_get)
+   ORDER     : integer, 3 (coskewness) or 4 (cokurtosis)
+   PP        : integer, number of assets
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the unique elements (as in M3mat2vec/M4mat2vec) of the factor part of XX, i.e., without the
+   sample part implied by the centered returns
+   */
+
+  int P = asInteger(PP), order = asInteger(ORDER);
+  hop_comoment X = hop_comoment_get(XX, order, P);
+  if (X.kind != HOP_FACTOR) error("the co-moments should be implied by a factor model.");
+  SEXP res = PROTECT(allocVector(REALSXP, (order == 3) ? n_unique3(P) : n_unique4(P)));
+  factor_pack(&X, P, hop_num_threads(asInteger(NTHREADS)), REAL(res));
+  UNPROTECT(1);
+  return res;
+}
+
+#endif
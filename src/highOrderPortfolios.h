@@ -0,0 +1,237 @@
+// Shared helpers for the native routines of package highOrderPortfolios.
+//
+// The co-skewness and co-kurtosis tensors are stored "packed", i.e., only the
+// unique elements are kept, in the same order as used by M3mat2vec/M4mat2vec:
+//   Phi: for (ii <= jj <= kk)          -> N(N+1)(N+2)/6 elements
+//   Psi: for (ii <= jj <= kk <= ll)    -> N(N+1)(N+2)(N+3)/24 elements
+
+#ifndef HIGHORDERPORTFOLIOS_H
+#define HIGHORDERPORTFOLIOS_H
+
+// Built as part of the package, or as the core library without R (core/Makefile), in which case the
+// R interface of each file is left out (#ifndef HOP_STANDALONE) and core/hop_standalone.h provides
+// the rest of the R API.
+#ifdef HOP_STANDALONE
+#include "hop_standalone.h"
+#else
+#include <R.h>
+#include <Rinternals.h>
+#endif
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+static inline int omp_get_thread_num(void) { return 0; }
+#endif
+
+// number of unique elements of a symmetric tensor of order 2, 3, and 4 over n assets
+static inline R_xlen_t n_unique2(R_xlen_t n) { return n * (n + 1) / 2; }
+static inline R_xlen_t n_unique3(R_xlen_t n) { return n * (n + 1) * (n + 2) / 6; }
+static inline R_xlen_t n_unique4(R_xlen_t n) { return n * (n + 1) * (n + 2) * (n + 3) / 24; }
+
+// position in the packed co-skewness vector of element (ii, jj, kk), with ii <= jj <= kk
+static inline R_xlen_t M3_index(int P, int ii, int jj, int kk) {
+  return (n_unique3(P) - n_unique3(P - ii)) + (n_unique2(P - ii) - n_unique2(P - jj)) + (kk - jj);
+}
+
+// position in the packed co-kurtosis vector of element (ii, jj, kk, ll), with ii <= jj <= kk <= ll
+static inline R_xlen_t M4_index(int P, int ii, int jj, int kk, int ll) {
+  return (n_unique4(P) - n_unique4(P - ii)) + (n_unique3(P - ii) - n_unique3(P - jj)) +
+    (n_unique2(P - jj) - n_unique2(P - kk)) + (ll - kk);
+}
+
+// OpenMP pragmas that compile away when OpenMP is not available
+#ifdef _OPENMP
+#define HOP_OMP(x) _Pragma(#x)
+#else
+#define HOP_OMP(x)
+#endif
+
+// number of threads to use (a non-positive request means the OpenMP default)
+static inline int hop_num_threads(int requested) {
+#ifdef _OPENMP
+  return requested > 0 ? requested : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+// wall-clock time in seconds (CPU time when OpenMP is not available)
+static inline double hop_time(void) {
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// sample mean, covariance, and packed co-skewness/co-kurtosis of a T x P returns matrix (moments.c)
+void comoments_sample(const double *X, int T, int P, int nthreads, double *mu, double *Sgm, double *Phi, double *Psi);
+// full P x P^2 co-skewness and P x P^3 co-kurtosis matrices from the packed ones (moments.c)
+void M3vec2mat_kernel(const double *X, int P, double *M);
+void M4vec2mat_kernel(const double *X, int P, double *M);
+
+// portfolio derivative kernels (port_kernels.c)
+void M3port_hess_kernel(const double *X, const double *W, int P, int nthreads, double *A);
+void M4port_hess_kernel(const double *X, const double *W, int P, int nthreads, double *B);
+double M3port_kernel(const double *X, const double *W, int P, int nthreads, double *grad);
+double M4port_kernel(const double *X, const double *W, int P, int nthreads, double *grad);
+void M3port_hess_kernel_f(const float *X, const double *W, int P, int nthreads, double *A);
+void M4port_hess_kernel_f(const float *X, const double *W, int P, int nthreads, double *B);
+double M3port_kernel_f(const float *X, const double *W, int P, int nthreads, double *grad);
+double M4port_kernel_f(const float *X, const double *W, int P, int nthreads, double *grad);
+
+// A co-skewness (order 3) or co-kurtosis (order 4) tensor in one of its storage formats (storage.c):
+//   HOP_PACKED        packed unique elements in double precision (numeric vector)
+//   HOP_PACKED_FLOAT  packed unique elements in single precision (raw vector with the float bits)
+//   HOP_LOWRANK       implied by the T x P centered returns Xc (numeric matrix with attribute
+//                     "coef" = (coef3, coef4)), as coef * sum_t Xc[t, ] (x) ... (x) Xc[t, ]
+//   HOP_FACTOR        implied by a K-factor model x = B f + e (list, see factor.c), as fcoef times
+//                     the co-moment of the model plus, when T > 0, coef times the low-rank sample one
+enum { HOP_PACKED = 0, HOP_PACKED_FLOAT = 1, HOP_LOWRANK = 2, HOP_FACTOR = 3 };
+typedef struct {
+  int kind, order;
+  int T;             // number of observations (HOP_LOWRANK, and HOP_FACTOR with shrinkage)
+  const double *x;   // packed elements (HOP_PACKED) or centered returns (HOP_LOWRANK, HOP_FACTOR)
+  const float *xf;   // packed elements (HOP_PACKED_FLOAT)
+  double coef;       // normalization (HOP_LOWRANK, HOP_FACTOR)
+  int K;             // number of factors (HOP_FACTOR)
+  const double *B;   // P x K loadings
+  const double *fx;  // packed co-moment of the factors
+  const double *Sf;  // K x K covariance of the factors
+  const double *s2;  // P idiosyncratic variances
+  const double *sk;  // P idiosyncratic third (order 3) or fourth (order 4) central moments
+  double fcoef;      // weight of the factor model
+} hop_comoment;
+
+#ifndef HOP_STANDALONE
+hop_comoment hop_comoment_get(SEXP X, int order, int P);
+hop_comoment factor_comoment_get(SEXP X, int order, int P);
+#endif
+double factor_port_kernel(const hop_comoment *X, const double *W, int P, double *grad);
+void factor_port_hess_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *H);
+void factor_pack(const hop_comoment *X, int P, int nthreads, double *out);
+double lowrank_port_kernel(const hop_comoment *X, const double *W, int P, double *grad);
+void lowrank_port_hess_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *H);
+void lowrank_port_batch_kernel(const hop_comoment *X3, const hop_comoment *X4, const double *W, int P, int K,
+                               int nthreads, double *skew, double *kurt);
+
+// the kernels above for any storage: value (and gradient), Phi*w or Psi*(w x w), batched, and the bound of
+// the Hessian of the MM and DC methods (packed storage only) (port_kernels.c)
+double hop_port_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *grad);
+void hop_port_hess_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *H);
+void hop_port_batch_kernel(const hop_comoment *X3, const hop_comoment *X4, const double *W, int P, int K,
+                           int nthreads, double *skew, double *kurt);
+double hop_hess_bound(const hop_comoment *X, int P, int use_max, int nthreads);
+
+// QP over the simplex {w >= 0, sum(w) == 1}, or over {sum(|w|) <= leverage, sum(w) == 1} when
+// leverage > 1: minimize 0.5*w'Qw - q'w (simplex_qp.c)
+typedef struct {
+  int N;
+  double leverage;  // bound on sum(|w|), 1 for the simplex
+  int diag;         // Q is diagonal and only its diagonal is stored
+  double *Q;        // N x N (or N if diag)
+  int nfree;        // number of free variables (not at their bound)
+  int *free;        // their indices, in the column order of R
+  int *is_free;     // N flags
+  int *sign;        // N, sign of the free variables (+1 for the simplex)
+  int l1;           // whether sum(|w|) == leverage is in the working set
+  double *R;        // upper triangular (leading nfree x nfree, leading dimension N), R'R = Q[free, free]
+  int factored;     // whether R corresponds to the current Q and free set
+  double *w;        // last solution, used as warm start
+  int has_w;
+  int iterations;   // active-set iterations of the last solve
+  double *work;     // 4N
+  int *iwork;       // N
+} simplex_qp;
+
+simplex_qp *sqp_alloc(int N);
+void sqp_free(simplex_qp *s);
+void sqp_set_Q(simplex_qp *s, const double *Q, int diag);
+void sqp_set_leverage(simplex_qp *s, double leverage);
+int sqp_solve(simplex_qp *s, const double *q, double *w);
+void simplex_diag_qp(int N, const double *d, double d_scalar, const double *q, double *w, double *work, int *iwork);
+void leverage_diag_qp(int N, const double *d, double d_scalar, double leverage, const double *q, double *w,
+                      double *work, int *iwork);
+
+// PSD approximation V diag(max(d, 0)) V' of a symmetric matrix, tracking the eigenspace of one sign
+// across calls (psd.c)
+typedef struct {
+  int N;
+  int side;         // +1 (positive) or -1 (negative) eigenspace tracked in X, 0 if none
+  int m;            // columns of X: the tracked eigenvectors followed by guards of the other sign
+  double *X;        // N x N, Ritz vectors of the last matrix
+  double *P;        // N x N, search directions of the last refinement
+  int has_P;
+  int n_eig, n_warm;
+} psd_tracker;
+
+psd_tracker *psd_alloc(int N);
+void psd_free(psd_tracker *t);
+// Hp = H+ (may be H) and, if need_L, its factor L (N x N room) with L L' = H+; returns the columns of L
+int psd_project(psd_tracker *t, const double *H, int need_L, double *Hp, double *L);
+
+// SCA loop of the Q-MVSK, MM, and DC methods on the sample moments (sca.c); the QP and PSD workspaces
+// are kept by the caller, and the trace arrays have room for maxiter + 1 iterations (4 columns for the
+// profile, NULL if not profiling), with the gradients of the moments at the solution in jac (N x 4)
+enum { SCA_QMVSK = 0, SCA_MM = 1, SCA_DC = 2 };
+typedef struct {
+  int method, maxiter, nthreads;
+  double tau_w, gamma, zeta, rho, ftol, wtol, stopval, leverage, maxtime;
+} sca_options;
+typedef struct {
+  int iterations, timed_out;
+  double *cpu_time, *objs, *prof, *jac;
+} sca_trace;
+
+void sca_run(const double *lmd, const double *mu, const double *Sgm, const hop_comoment *Phi, const hop_comoment *Psi,
+             int N, const sca_options *opt, simplex_qp *qp, psd_tracker *psd, double *w, sca_trace *tr);
+
+// skew-t model: location, skewness, scatter (N x N), and the coefficients (a11, ..., a43) of the
+// moments; objective and derivatives, Hessian bounds, and SCA loop of the L-MVSK and DC methods (with
+// the options of sca_run() that apply, and the gradients in jac as 4 x N) (skew_t.c)
+enum { SKEWT_LMVSK = 0, SKEWT_DC = 1 };
+typedef struct {
+  int N;
+  const double *mu, *gamma, *scatter, *a;
+} skewt_model;
+
+double skewt_moments(const skewt_model *m, const double *w, const double *lmd, double *phi, double *jac,
+                     double *grad, double *u, double *hess_coef);
+void skewt_hess_bounds(const skewt_model *m, int nthreads, double *b);
+void skewt_sca_run(const skewt_model *m, const double *lmd, const sca_options *opt, simplex_qp *qp, double *w,
+                   sca_trace *tr);
+
+// L-MVSKT loop of the MVSK tilting design on the sample moments (tilting.c): maximize the improvement delta
+// (in the units d) of the moments of w over w0_moments, those of the reference portfolio w0; the trace
+// arrays have room for maxiter + 1 iterations (4 columns for the profile, NULL if not profiling), as do
+// the LP and QP iterations, whether the LP started from the previous basis, and the exit status of both
+// solvers (NULL if not needed). The status codes are those of lpSolveAPI::solve(), TILT_NOT_SOLVED when
+// no LP was needed.
+enum { TILT_NOT_SOLVED = -1, TILT_OPTIMAL = 0, TILT_SUBOPTIMAL = 1, TILT_INFEASIBLE = 2, TILT_UNBOUNDED = 3,
+       TILT_NUMFAILURE = 5 };
+typedef struct {
+  int maxiter, nthreads;
+  double leverage, kappa, tau_w, tau_delta, gamma, zeta, theta, ftol, wtol, stopval;
+} tilt_options;
+typedef struct {
+  int iterations;
+  double delta, moments[4];
+  double *cpu_time, *objs, *prof;
+  int *lp_iter, *lp_warm, *qp_iter;
+  int *lp_status, *qp_status;
+} tilt_trace;
+
+void tilt_run(const double *d, const double *mu, const double *Sgm, const hop_comoment *Phi, const hop_comoment *Psi,
+              int N, const double *w0, const double *w0_moments, const tilt_options *opt, double *w, tilt_trace *tr);
+
+// EM fit of the skew-t model from the initial values in mu, gamma, S, nu (skew_t_em.c)
+int skewt_em_fit(const double *X, int T, int N, double *mu, double *gam, double *S, double *nu, double nu_lb,
+                 int maxiter, double ptol, double ftol, int pxem, int nthreads, double *loglik, double *frozen);
+
+// Euclidean projection onto the simplex, optionally intersected with the box [0, ub] (projection.c)
+void simplex_project(int N, const double *y, double *x, double *work);
+void simplex_project_box(int N, const double *y, const double *ub, double *x, double *work, int *iwork);
+
+#endif
@@ -15,6 +15,44 @@ extern SEXP M3port_grad(SEXP, SEXP, SEXP);
 extern SEXP M3port(SEXP, SEXP, SEXP);
 extern SEXP M4port(SEXP, SEXP, SEXP);
 extern SEXP M4port_grad(SEXP, SEXP, SEXP);
+extern SEXP M1234sample(SEXP, SEXP);
+extern SEXP M3vec2shred(SEXP, SEXP);
+extern SEXP M4vec2shred(SEXP, SEXP);
+extern SEXP M3port_derivs(SEXP, SEXP, SEXP, SEXP);
+extern SEXP M4port_derivs(SEXP, SEXP, SEXP, SEXP);
+extern SEXP M3port_valgrad(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP M4port_valgrad(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP M34port_batch(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP skewt_eval(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP skewt_bounds(SEXP, SEXP, SEXP, SEXP);
+extern SEXP simplex_QP_setup(SEXP, SEXP);
+extern SEXP simplex_QP_solve(SEXP, SEXP, SEXP);
+extern SEXP project_simplex(SEXP, SEXP, SEXP);
+extern SEXP MVSK_sca(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP comoments_acc_init(SEXP, SEXP, SEXP, SEXP);
+extern SEXP comoments_acc_update(SEXP, SEXP, SEXP);
+extern SEXP comoments_acc_extract(SEXP, SEXP);
+extern SEXP moments_file_estimate(SEXP, SEXP, SEXP, SEXP);
+extern SEXP moments_file_write(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP moments_file_read(SEXP, SEXP);
+extern SEXP comoments_to_float(SEXP);
+extern SEXP comoments_from_float(SEXP);
+extern SEXP lowrank_derivs(SEXP, SEXP, SEXP, SEXP);
+extern SEXP socp_block(SEXP, SEXP);
+extern SEXP socp_cone_block(SEXP, SEXP, SEXP);
+extern SEXP socp_assemble(SEXP, SEXP);
+extern SEXP psd_tracker_init(SEXP);
+extern SEXP psd_tracker_project(SEXP, SEXP, SEXP);
+extern SEXP skew_t_em(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP simplex_QP_iterations(SEXP);
+extern SEXP hop_wtime(void);
+extern SEXP comoments_hess_bound(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP MVSKtilting_lin(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP factor_comoments_pack(SEXP, SEXP, SEXP, SEXP);
+extern SEXP MVSK_skewt_sca(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+
+/* ALTREP class of the memory-mapped moments (moments_file.c) */
+extern void hop_init_mmap_class(DllInfo *dll);
 
 static const R_CallMethodDef CallEntries[] = {
   {"M3mat2vec",        (DL_FUNC) &M3mat2vec,         2},
@@ -25,6 +63,41 @@ static const R_CallMethodDef CallEntries[] = {
   {"M3port",           (DL_FUNC) &M3port,            3},
   {"M4port",           (DL_FUNC) &M4port,            3},
   {"M4port_grad",      (DL_FUNC) &M4port_grad,       3},
+  {"M1234sample",      (DL_FUNC) &M1234sample,       2},
+  {"M3vec2shred",      (DL_FUNC) &M3vec2shred,       2},
+  {"M4vec2shred",      (DL_FUNC) &M4vec2shred,       2},
+  {"M3port_derivs",    (DL_FUNC) &M3port_derivs,     4},
+  {"M4port_derivs",    (DL_FUNC) &M4port_derivs,     4},
+  {"M3port_valgrad",   (DL_FUNC) &M3port_valgrad,    5},
+  {"M4port_valgrad",   (DL_FUNC) &M4port_valgrad,    5},
+  {"M34port_batch",    (DL_FUNC) &M34port_batch,     5},
+  {"skewt_eval",       (DL_FUNC) &skewt_eval,        7},
+  {"skewt_bounds",     (DL_FUNC) &skewt_bounds,      4},
+  {"simplex_QP_setup", (DL_FUNC) &simplex_QP_setup,  2},
+  {"simplex_QP_solve", (DL_FUNC) &simplex_QP_solve,  3},
+  {"MVSK_sca",         (DL_FUNC) &MVSK_sca,         11},
+  {"project_simplex",  (DL_FUNC) &project_simplex,   3},
+  {"comoments_acc_init",    (DL_FUNC) &comoments_acc_init,    4},
+  {"comoments_acc_update",  (DL_FUNC) &comoments_acc_update,  3},
+  {"comoments_acc_extract", (DL_FUNC) &comoments_acc_extract, 2},
+  {"moments_file_estimate", (DL_FUNC) &moments_file_estimate, 4},
+  {"moments_file_write",    (DL_FUNC) &moments_file_write,    7},
+  {"moments_file_read",     (DL_FUNC) &moments_file_read,     2},
+  {"comoments_to_float",    (DL_FUNC) &comoments_to_float,    1},
+  {"comoments_from_float",  (DL_FUNC) &comoments_from_float,  1},
+  {"lowrank_derivs",        (DL_FUNC) &lowrank_derivs,        4},
+  {"socp_block",            (DL_FUNC) &socp_block,            2},
+  {"socp_cone_block",       (DL_FUNC) &socp_cone_block,       3},
+  {"socp_assemble",         (DL_FUNC) &socp_assemble,         2},
+  {"psd_tracker_init",      (DL_FUNC) &psd_tracker_init,      1},
+  {"psd_tracker_project",   (DL_FUNC) &psd_tracker_project,   3},
+  {"skew_t_em",             (DL_FUNC) &skew_t_em,             11},
+  {"simplex_QP_iterations", (DL_FUNC) &simplex_QP_iterations, 1},
+  {"hop_wtime",             (DL_FUNC) &hop_wtime,             0},
+  {"comoments_hess_bound",  (DL_FUNC) &comoments_hess_bound,  5},
+  {"MVSKtilting_lin",       (DL_FUNC) &MVSKtilting_lin,       12},
+  {"factor_comoments_pack", (DL_FUNC) &factor_comoments_pack,  4},
+  {"MVSK_skewt_sca",        (DL_FUNC) &MVSK_skewt_sca,        10},
   {NULL, NULL, 0}
 };
 
@@ -32,4 +105,5 @@ void R_init_highOrderPortfolios(DllInfo *dll)
 {
   R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
   R_useDynamicSymbols(dll, FALSE);
+  hop_init_mmap_class(dll);
 }
@@ -0,0 +1,281 @@
+// Native estimation of the sample co-moments of a returns matrix.
+//
+// All four moments are obtained from one sweep over the (centered) returns, writing directly
+// into the packed unique-element layout of the co-skewness and co-kurtosis tensors (see
+// highOrderPortfolios.h). The full N x N^2 and N x N^3 matrices are never built.
+
+#include "highOrderPortfolios.h"
+#include <limits.h>
+
+// number of observations processed per block, chosen so that a block of returns fits in L2 cache
+static int row_block_size(int T, int P) {
+  int TB = (int)(32768 / (P > 0 ? P : 1));
+  if (TB < 16) TB = 16;
+  return TB < T ? TB : T;
+}
+
+void comoments_sample(const double *X, int T, int P, int nthreads,
+                      double *mu, double *Sgm, double *Phi, double *Psi) {
+  int TB = row_block_size(T, P);
+  int nblocks = (T + TB - 1) / TB;
+
+  // column means
+  for (int ii = 0; ii < P; ii++) {
+    double s = 0.0;
+    for (int t = 0; t < T; t++) s += X[(R_xlen_t)ii * T + t];
+    mu[ii] = s / T;
+  }
+
+  // centered returns, stored block by block (column-major within each block)
+  double *Xc = (double *) R_alloc((size_t)T * P, sizeof(double));
+  for (int b = 0; b < nblocks; b++) {
+    int t0 = b * TB, nb = (t0 + TB <= T) ? TB : T - t0;
+    double *Xb = Xc + (R_xlen_t)t0 * P;
+    for (int ii = 0; ii < P; ii++)
+      for (int t = 0; t < nb; t++)
+        Xb[(R_xlen_t)ii * nb + t] = X[(R_xlen_t)ii * T + t0 + t] - mu[ii];
+  }
+
+  memset(Sgm, 0, sizeof(double) * (size_t)P * P);
+  memset(Phi, 0, sizeof(double) * (size_t)n_unique3(P));
+  memset(Psi, 0, sizeof(double) * (size_t)n_unique4(P));
+
+  // per-thread products of two and three columns of a block
+  double *yz = (double *) R_alloc(2 * (size_t)TB * nthreads, sizeof(double));
+
+  // each leading index ii owns a disjoint slice of the packed outputs
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+    double *y = yz + 2 * (R_xlen_t)TB * omp_get_thread_num();
+    double *z = y + TB;
+    for (int b = 0; b < nblocks; b++) {
+      int t0 = b * TB, nb = (t0 + TB <= T) ? TB : T - t0;
+      const double *Xb = Xc + (R_xlen_t)t0 * P;
+      const double *xi = Xb + (R_xlen_t)ii * nb;
+      R_xlen_t iter3 = M3_index(P, ii, ii, ii);
+      R_xlen_t iter4 = M4_index(P, ii, ii, ii, ii);
+      for (int jj = ii; jj < P; jj++) {
+        const double *xj = Xb + (R_xlen_t)jj * nb;
+        double s2 = 0.0;
+        for (int t = 0; t < nb; t++) {
+          y[t] = xi[t] * xj[t];
+          s2 += y[t];
+        }
+        Sgm[(R_xlen_t)jj * P + ii] += s2;
+        for (int kk = jj; kk < P; kk++) {
+          const double *xk = Xb + (R_xlen_t)kk * nb;
+          double s3 = 0.0;
+          for (int t = 0; t < nb; t++) {
+            z[t] = y[t] * xk[t];
+            s3 += z[t];
+          }
+          Phi[iter3++] += s3;
+          for (int ll = kk; ll < P; ll++) {
+            const double *xl = Xb + (R_xlen_t)ll * nb;
+            double s4 = 0.0;
+            for (int t = 0; t < nb; t++) s4 += z[t] * xl[t];
+            Psi[iter4++] += s4;
+          } // loop ll
+        } // loop kk
+      } // loop jj
+    } // loop blocks
+  } // loop ii
+
+  // normalize as in stats::cov (T - 1) and PerformanceAnalytics::M3.MM/M4.MM (T)
+  for (int ii = 0; ii < P; ii++)
+    for (int jj = ii; jj < P; jj++) {
+      double s = Sgm[(R_xlen_t)jj * P + ii] / (T - 1);
+      Sgm[(R_xlen_t)jj * P + ii] = s;
+      Sgm[(R_xlen_t)ii * P + jj] = s;
+    }
+  for (R_xlen_t iter = 0; iter < n_unique3(P); iter++) Phi[iter] /= T;
+  for (R_xlen_t iter = 0; iter < n_unique4(P); iter++) Psi[iter] /= T;
+}
+
+// full co-skewness (P x P^2) and co-kurtosis (P x P^3) matrices from their unique elements, into M: each
+// element is placed at every permutation of its indices (those repeated are written more than once)
+static const int perm3[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+void M3vec2mat_kernel(const double *X, int P, double *M) {
+  R_xlen_t iter = 0;
+  for (int ii = 0; ii < P; ii++)
+    for (int jj = ii; jj < P; jj++)
+      for (int kk = jj; kk < P; kk++) {
+        const int idx[3] = {ii, jj, kk};
+        double x = X[iter++];
+        for (int p = 0; p < 6; p++)
+          M[((R_xlen_t)idx[perm3[p][0]] * P + idx[perm3[p][1]]) * P + idx[perm3[p][2]]] = x;
+      }
+}
+
+void M4vec2mat_kernel(const double *X, int P, double *M) {
+  R_xlen_t iter = 0;
+  for (int ii = 0; ii < P; ii++)
+    for (int jj = ii; jj < P; jj++)
+      for (int kk = jj; kk < P; kk++)
+        for (int ll = kk; ll < P; ll++) {
+          const int idx[4] = {ii, jj, kk, ll};
+          double x = X[iter++];
+          // the first index in each position, then the permutations of the other three
+          for (int a = 0; a < 4; a++) {
+            int rest[3], r = 0;
+            for (int b = 0; b < 4; b++) if (b != a) rest[r++] = idx[b];
+            for (int p = 0; p < 6; p++)
+              M[(((R_xlen_t)idx[a] * P + rest[perm3[p][0]]) * P + rest[perm3[p][1]]) * P + rest[perm3[p][2]]] = x;
+          }
+        }
+}
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+SEXP  M1234sample(SEXP XX, SEXP NTHREADS){
+  /*
+   arguments
+   XX        : numeric T x N matrix with the returns (each column is one asset)
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns a list with the mean vector, covariance matrix, and the unique elements of
+   the coskewness and cokurtosis matrices
+   */
+
+  int T = nrows(XX), P = ncols(XX);
+  if (T < 2) error("at least two observations are needed.");
+
+  const char *names[] = {"mu", "Sgm", "Phi", "Psi", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(res, 0, allocVector(REALSXP, P));
+  SET_VECTOR_ELT(res, 1, allocMatrix(REALSXP, P, P));
+  SET_VECTOR_ELT(res, 2, allocVector(REALSXP, n_unique3(P)));
+  SET_VECTOR_ELT(res, 3, allocVector(REALSXP, n_unique4(P)));
+
+  comoments_sample(REAL(XX), T, P, hop_num_threads(asInteger(NTHREADS)),
+                   REAL(VECTOR_ELT(res, 0)), REAL(VECTOR_ELT(res, 1)),
+                   REAL(VECTOR_ELT(res, 2)), REAL(VECTOR_ELT(res, 3)));
+
+  UNPROTECT(1);
+  return res;
+}
+
+// P x ncol matrix, with the sizes checked in double precision (P^3 overflows int for P >= 1291)
+static SEXP alloc_comoment_matrix(int P, double ncol) {
+  if ((double) P * ncol > (double) R_XLEN_T_MAX || ncol > INT_MAX)
+    error("the full co-moment matrix of %d assets is too large (use the packed version).", P);
+  SEXP M = PROTECT(allocVector(REALSXP, (R_xlen_t) P * (R_xlen_t) ncol));
+  SEXP dim = PROTECT(allocVector(INTSXP, 2));
+  INTEGER(dim)[0] = P;
+  INTEGER(dim)[1] = (int) ncol;
+  setAttrib(M, R_DimSymbol, dim);
+  UNPROTECT(2);
+  return M;
+}
+
+SEXP  M3vec2mat(SEXP XX, SEXP PP){
+  /*
+   arguments
+   XX        : numeric vector with unique elements of a coskewness matrix
+   PP        : integer, number of assets
+
+   returns the full P x P^2 coskewness matrix
+   */
+
+  int P = asInteger(PP);
+  SEXP M = PROTECT(alloc_comoment_matrix(P, (double) P * P));
+  M3vec2mat_kernel(REAL(XX), P, REAL(M));
+  UNPROTECT(1);
+  return M;
+}
+
+SEXP  M4vec2mat(SEXP XX, SEXP PP){
+  /*
+   arguments
+   XX        : numeric vector with unique elements of a cokurtosis matrix
+   PP        : integer, number of assets
+
+   returns the full P x P^3 cokurtosis matrix
+   */
+
+  int P = asInteger(PP);
+  SEXP M = PROTECT(alloc_comoment_matrix(P, (double) P * P * P));
+  M4vec2mat_kernel(REAL(XX), P, REAL(M));
+  UNPROTECT(1);
+  return M;
+}
+
+SEXP  M3vec2shred(SEXP XX, SEXP PP){
+  /*
+   arguments
+   XX        : numeric vector with unique elements of a coskewness matrix
+   PP        : integer, number of assets
+
+   returns the list of the N slices Phi[, , i] (each a N x N matrix)
+   */
+
+  double *X = REAL(XX);
+  int P = asInteger(PP);
+
+  SEXP shred = PROTECT(allocVector(VECSXP, P));
+  double **rshred = (double **) R_alloc(P, sizeof(double *));
+  for (int ii = 0; ii < P; ii++) {
+    SET_VECTOR_ELT(shred, ii, allocMatrix(REALSXP, P, P));
+    rshred[ii] = REAL(VECTOR_ELT(shred, ii));
+  }
+
+  R_xlen_t iter = 0;
+  for (int ii = 0; ii < P; ii++) {
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        // place the element into every slice it belongs to (both triangles)
+        double x = X[iter++];
+        rshred[ii][jj * P + kk] = x; rshred[ii][kk * P + jj] = x;
+        rshred[jj][ii * P + kk] = x; rshred[jj][kk * P + ii] = x;
+        rshred[kk][ii * P + jj] = x; rshred[kk][jj * P + ii] = x;
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  UNPROTECT(1);
+  return shred;
+}
+
+SEXP  M4vec2shred(SEXP XX, SEXP PP){
+  /*
+   arguments
+   XX        : numeric vector with unique elements of a cokurtosis matrix
+   PP        : integer, number of assets
+
+   returns the list of the N slices Psi[, , , i], each one in packed coskewness form
+   */
+
+  double *X = REAL(XX);
+  int P = asInteger(PP);
+
+  SEXP shred = PROTECT(allocVector(VECSXP, P));
+  double **rshred = (double **) R_alloc(P, sizeof(double *));
+  for (int ii = 0; ii < P; ii++) {
+    SET_VECTOR_ELT(shred, ii, allocVector(REALSXP, n_unique3(P)));
+    rshred[ii] = REAL(VECTOR_ELT(shred, ii));
+  }
+
+  R_xlen_t iter = 0;
+  for (int ii = 0; ii < P; ii++) {
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        for (int ll = kk; ll < P; ll++) {
+          // drop one occurrence of each distinct index; the remaining (sorted) triple
+          // gives the position within that slice
+          double x = X[iter++];
+          rshred[ii][M3_index(P, jj, kk, ll)] = x;
+          if (jj != ii) rshred[jj][M3_index(P, ii, kk, ll)] = x;
+          if (kk != jj) rshred[kk][M3_index(P, ii, jj, ll)] = x;
+          if (ll != kk) rshred[ll][M3_index(P, ii, jj, kk)] = x;
+        } // loop ll
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  UNPROTECT(1);
+  return shred;
+}
+
+#endif
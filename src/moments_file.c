@@ -0,0 +1,424 @@
+// On-disk store of the sample moments, read back through a memory mapping.
+//
+// File layout (native byte order, checked with an endianness marker):
+//   header (one page):  magic "HOPMOM01", format version, N, T, whether the moments are
+//                       centered and whether their magnitude was adjusted (with the four scale
+//                       factors of adjust_magnitude), offset and length of each section, and a
+//                       checksum of the sections
+//   sections (each starting at a page boundary):  mu (N), Sgm (N x N), Phi and Psi packed as in
+//                       M3mat2vec/M4mat2vec (see highOrderPortfolios.h)
+//
+// The moments can be estimated straight into the file, so the packed co-kurtosis is never held in
+// the R heap. On reading, each section becomes an ALTREP numeric vector whose data pointer is the
+// mapped memory: the portfolio kernels work on the mapping directly (REAL() returns it) and many
+// processes mapping the same file share a single copy in the page cache. The mapping is private,
+// so a write to one of the vectors copies the touched page instead of modifying the file.
+//
+// A file is written as path.tmp and then renamed over path, so that the processes that have the
+// previous file mapped keep reading it (a truncation in place would make them fault on access).
+
+#include "highOrderPortfolios.h"
+#include <R_ext/Altrep.h>
+#include <R_ext/Rdynload.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define MOMFILE_MAGIC "HOPMOM01"
+#define MOMFILE_VERSION 1
+#define MOMFILE_ENDIAN 0x01020304u
+#define MOMFILE_PAGE 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  int64_t N, T;
+  int32_t centered;
+  int32_t adjusted;
+  double scale[4];      // the moments were divided by these (1 if not adjusted)
+  uint64_t offset[4];   // in bytes, of mu, Sgm, Phi, Psi
+  uint64_t length[4];   // in doubles
+  uint64_t checksum;
+} momfile_header;
+
+static uint64_t page_round(uint64_t x) { return (x + MOMFILE_PAGE - 1) / MOMFILE_PAGE * MOMFILE_PAGE; }
+
+static void momfile_layout(momfile_header *h, int64_t N, int64_t T) {
+  memset(h, 0, sizeof(momfile_header));
+  memcpy(h->magic, MOMFILE_MAGIC, 8);
+  h->version = MOMFILE_VERSION;
+  h->endian = MOMFILE_ENDIAN;
+  h->N = N;
+  h->T = T;
+  h->centered = 1;
+  for (int k = 0; k < 4; k++) h->scale[k] = 1.0;
+  h->length[0] = N;
+  h->length[1] = N * N;
+  h->length[2] = n_unique3(N);
+  h->length[3] = n_unique4(N);
+  uint64_t pos = MOMFILE_PAGE;
+  for (int k = 0; k < 4; k++) {
+    h->offset[k] = pos;
+    pos = page_round(pos + h->length[k] * sizeof(double));
+  }
+}
+
+static uint64_t momfile_size(const momfile_header *h) {
+  return page_round(h->offset[3] + h->length[3] * sizeof(double));
+}
+
+// 64-bit multiplicative hash over the doubles of the sections, 4 independent lanes
+static uint64_t momfile_checksum(const momfile_header *h, const char *base) {
+  uint64_t lane[4] = {0x9E3779B97F4A7C15u, 0xC2B2AE3D27D4EB4Fu, 0x165667B19E3779F9u, 0x27D4EB2F165667C5u};
+  for (int k = 0; k < 4; k++) {
+    const uint64_t *x = (const uint64_t *) (base + h->offset[k]);
+    uint64_t n = h->length[k], i = 0;
+    for (; i + 4 <= n; i += 4)
+      for (int l = 0; l < 4; l++) lane[l] = (lane[l] ^ x[i + l]) * 0x100000001B3u;
+    for (; i < n; i++) lane[0] = (lane[0] ^ x[i]) * 0x100000001B3u;
+  }
+  return lane[0] ^ (lane[1] << 1) ^ (lane[2] << 2) ^ (lane[3] << 3);
+}
+
+
+// platform-specific mapping of a whole file ---------------------------------------------------------
+
+typedef struct {
+  void *addr;
+  uint64_t size;
+  char *path, *tmp;  // writable: the destination, and the file written until momfile_commit()
+  int committed;
+#ifdef _WIN32
+  HANDLE file, map;
+#endif
+} momfile_map;
+
+static void momfile_free(momfile_map *m) {
+  if (m->tmp) {
+    if (!m->committed) remove(m->tmp);
+    R_Free(m->tmp);
+    R_Free(m->path);
+  }
+  R_Free(m);
+}
+
+// writable = 1: create path.tmp with the given size and map it shared for writing (momfile_commit()
+// moves it over path); writable = 0: map an existing file privately (copy-on-write)
+static momfile_map *momfile_open(const char *path, int writable, uint64_t size) {
+  momfile_map *m = R_Calloc(1, momfile_map);
+  const char *fname = path;
+  if (writable) {
+    m->path = R_Calloc(strlen(path) + 1, char);
+    m->tmp = R_Calloc(strlen(path) + 5, char);
+    strcpy(m->path, path);
+    snprintf(m->tmp, strlen(path) + 5, "%s.tmp", path);
+    fname = m->tmp;
+  }
+#ifdef _WIN32
+  m->file = CreateFileA(fname, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL,
+                        writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m->file == INVALID_HANDLE_VALUE) {
+    momfile_free(m);
+    error("cannot open file '%s'.", fname);
+  }
+  if (!writable) {
+    LARGE_INTEGER sz;
+    GetFileSizeEx(m->file, &sz);
+    size = (uint64_t) sz.QuadPart;
+  }
+  m->size = size;
+  m->map = CreateFileMappingA(m->file, NULL, writable ? PAGE_READWRITE : PAGE_WRITECOPY,
+                              (DWORD) (size >> 32), (DWORD) (size & 0xFFFFFFFFu), NULL);
+  m->addr = m->map ? MapViewOfFile(m->map, writable ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, 0) : NULL;
+  if (!m->addr) {
+    if (m->map) CloseHandle(m->map);
+    CloseHandle(m->file);
+    momfile_free(m);
+    error("cannot map file '%s'.", fname);
+  }
+#else
+  int fd = open(fname, writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+  if (fd < 0) {
+    momfile_free(m);
+    error("cannot open file '%s': %s.", fname, strerror(errno));
+  }
+  if (writable) {
+    if (ftruncate(fd, (off_t) size) != 0) {
+      int err = errno;
+      close(fd);
+      momfile_free(m);
+      error("cannot allocate %.0f bytes for file '%s': %s.", (double) size, fname, strerror(err));
+    }
+  } else {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      int err = errno;
+      close(fd);
+      momfile_free(m);
+      error("cannot get the size of file '%s': %s.", fname, strerror(err));
+    }
+    size = (uint64_t) st.st_size;
+  }
+  m->size = size;
+  m->addr = size ? mmap(NULL, size, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);  // the mapping keeps its own reference
+  if (m->addr == MAP_FAILED) {
+    m->addr = NULL;
+    momfile_free(m);
+    error("cannot map file '%s'.", fname);
+  }
+#endif
+  return m;
+}
+
+static void momfile_unmap(momfile_map *m) {
+  if (!m->addr) return;
+#ifdef _WIN32
+  UnmapViewOfFile(m->addr);
+  CloseHandle(m->map);
+  CloseHandle(m->file);
+#else
+  munmap(m->addr, m->size);
+#endif
+  m->addr = NULL;
+}
+
+// unmapped, and the temporary file of a writable one removed if not committed
+static void momfile_close(momfile_map *m) {
+  if (!m) return;
+  momfile_unmap(m);
+  momfile_free(m);
+}
+
+// write the mapping of a writable file back to disk and move it over the destination
+static void momfile_commit(momfile_map *m) {
+#ifdef _WIN32
+  int ok = FlushViewOfFile(m->addr, 0) && FlushFileBuffers(m->file);
+  momfile_unmap(m);  // a mapped file cannot be moved
+  if (!ok) error("cannot write file '%s'.", m->tmp);
+  if (!MoveFileExA(m->tmp, m->path, MOVEFILE_REPLACE_EXISTING))
+    error("cannot replace file '%s' (is it mapped by another process?).", m->path);
+#else
+  if (msync(m->addr, m->size, MS_SYNC) != 0) error("cannot write file '%s': %s.", m->tmp, strerror(errno));
+  if (rename(m->tmp, m->path) != 0) error("cannot replace file '%s': %s.", m->path, strerror(errno));
+#endif
+  m->committed = 1;
+}
+
+static void momfile_map_finalizer(SEXP ptr) {
+  momfile_close((momfile_map *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+
+// ALTREP numeric vector viewing a section of a mapping ---------------------------------------------
+//   data1: external pointer to the momfile_map (shared by the sections of a file)
+//   data2: numeric vector (offset in bytes, length)
+
+static R_altrep_class_t mmap_real_class;
+
+static double *mmap_real_ptr(SEXP x) {
+  momfile_map *m = (momfile_map *) R_ExternalPtrAddr(R_altrep_data1(x));
+  if (!m) error("the memory mapping of the moments file has been released.");
+  return (double *) ((char *) m->addr + (uint64_t) REAL(R_altrep_data2(x))[0]);
+}
+
+static R_xlen_t mmap_real_Length(SEXP x) { return (R_xlen_t) REAL(R_altrep_data2(x))[1]; }
+
+static void *mmap_real_Dataptr(SEXP x, Rboolean writeable) { return mmap_real_ptr(x); }
+
+static const void *mmap_real_Dataptr_or_null(SEXP x) { return mmap_real_ptr(x); }
+
+static double mmap_real_Elt(SEXP x, R_xlen_t i) { return mmap_real_ptr(x)[i]; }
+
+static R_xlen_t mmap_real_Get_region(SEXP x, R_xlen_t i, R_xlen_t n, double *buf) {
+  R_xlen_t len = mmap_real_Length(x);
+  R_xlen_t ncopy = (i + n > len) ? len - i : n;
+  memcpy(buf, mmap_real_ptr(x) + i, sizeof(double) * (size_t) ncopy);
+  return ncopy;
+}
+
+static Rboolean mmap_real_Inspect(SEXP x, int pre, int deep, int pvec, void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf(" memory-mapped moments section (length %.0f)\n", (double) mmap_real_Length(x));
+  return TRUE;
+}
+
+void hop_init_mmap_class(DllInfo *dll) {
+  R_altrep_class_t cls = R_make_altreal_class("mmap_real", "highOrderPortfolios", dll);
+  mmap_real_class = cls;
+  R_set_altrep_Length_method(cls, mmap_real_Length);
+  R_set_altrep_Inspect_method(cls, mmap_real_Inspect);
+  R_set_altvec_Dataptr_method(cls, mmap_real_Dataptr);
+  R_set_altvec_Dataptr_or_null_method(cls, mmap_real_Dataptr_or_null);
+  R_set_altreal_Elt_method(cls, mmap_real_Elt);
+  R_set_altreal_Get_region_method(cls, mmap_real_Get_region);
+}
+
+static SEXP mmap_real_section(SEXP map_ptr, const momfile_header *h, int k) {
+  SEXP info = PROTECT(allocVector(REALSXP, 2));
+  REAL(info)[0] = (double) h->offset[k];
+  REAL(info)[1] = (double) h->length[k];
+  SEXP x = R_new_altrep(mmap_real_class, map_ptr, info);
+  UNPROTECT(1);
+  return x;
+}
+
+
+// reading and writing ------------------------------------------------------------------------------
+
+static void momfile_check_header(const momfile_header *h, uint64_t size, const char *path) {
+  if (size < MOMFILE_PAGE || memcmp(h->magic, MOMFILE_MAGIC, 8) != 0)
+    error("file '%s' is not a moments file.", path);
+  if (h->endian != MOMFILE_ENDIAN)
+    error("file '%s' was written on a machine with a different byte order.", path);
+  if (h->version != MOMFILE_VERSION)
+    error("file '%s' has an unsupported format version (%u).", path, (unsigned) h->version);
+  momfile_header ref;
+  momfile_layout(&ref, h->N, h->T);
+  for (int k = 0; k < 4; k++)
+    if (h->offset[k] != ref.offset[k] || h->length[k] != ref.length[k])
+      error("file '%s' has an inconsistent layout.", path);
+  if (momfile_size(h) > size)
+    error("file '%s' is truncated.", path);
+}
+
+// divide the moments by the magnitude of the moments of the equally weighted portfolio (as
+// adjust_magnitude in estimate_sample_moments()), recording the scale factors in the header
+static void momfile_adjust_magnitude(momfile_header *h, char *base, int nthreads) {
+  int N = (int) h->N;
+  double *sec[4];
+  for (int k = 0; k < 4; k++) sec[k] = (double *) (base + h->offset[k]);
+  double *w = (double *) R_alloc(N, sizeof(double));
+  for (int i = 0; i < N; i++) w[i] = 1.0 / N;
+  double d[4] = {0.0, 0.0, 0.0, 0.0};
+  for (int i = 0; i < N; i++) d[0] += sec[0][i] * w[i];
+  for (R_xlen_t k = 0; k < (R_xlen_t) N * N; k++) d[1] += sec[1][k] * w[0] * w[0];
+  d[2] = M3port_kernel(sec[2], w, N, nthreads, NULL);
+  d[3] = M4port_kernel(sec[3], w, N, nthreads, NULL);
+  for (int k = 0; k < 4; k++) {
+    h->scale[k] = fabs(d[k]);
+    for (uint64_t i = 0; i < h->length[k]; i++) sec[k][i] /= h->scale[k];
+  }
+  h->adjusted = 1;
+}
+
+static void momfile_finish(momfile_map *m, momfile_header *h) {
+  h->checksum = momfile_checksum(h, (const char *) m->addr);
+  memcpy(m->addr, h, sizeof(momfile_header));
+  momfile_commit(m);
+}
+
+SEXP  moments_file_estimate(SEXP XX, SEXP PATH, SEXP ADJUST, SEXP NTHREADS){
+  /*
+   arguments
+   XX        : numeric T x N matrix with the returns (each column is one asset)
+   PATH      : string, file to create
+   ADJUST    : logical, whether to adjust the magnitude of the moments
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   estimates the sample moments directly into the file; returns NULL
+   */
+
+  int T = nrows(XX), P = ncols(XX), nthreads = hop_num_threads(asInteger(NTHREADS));
+  if (T < 2) error("at least two observations are needed.");
+  const char *path = CHAR(STRING_ELT(PATH, 0));
+  momfile_header h;
+  momfile_layout(&h, P, T);
+
+  momfile_map *m = momfile_open(path, 1, momfile_size(&h));
+  SEXP map_ptr = PROTECT(R_MakeExternalPtr(m, R_NilValue, R_NilValue));  // unmapped (and removed) also on error
+  R_RegisterCFinalizerEx(map_ptr, momfile_map_finalizer, TRUE);
+  char *base = (char *) m->addr;
+  comoments_sample(REAL(XX), T, P, nthreads, (double *) (base + h.offset[0]), (double *) (base + h.offset[1]),
+                   (double *) (base + h.offset[2]), (double *) (base + h.offset[3]));
+  if (asLogical(ADJUST)) momfile_adjust_magnitude(&h, base, nthreads);
+  momfile_finish(m, &h);
+
+  momfile_close(m);
+  R_ClearExternalPtr(map_ptr);
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+SEXP  moments_file_write(SEXP MU, SEXP SGM, SEXP PHI, SEXP PSI, SEXP TT, SEXP SCALE, SEXP PATH){
+  /*
+   arguments
+   MU, SGM   : numeric vector and N x N matrix, mean and covariance
+   PHI, PSI  : numeric vectors with the unique elements of the coskewness and cokurtosis matrices
+   TT        : integer, number of observations (NA if unknown)
+   SCALE     : NULL, or numeric vector of length 4 with the factors the moments were divided by
+   PATH      : string, file to create
+
+   writes the moments to the file; returns NULL
+   */
+
+  int N = LENGTH(MU);
+  const char *path = CHAR(STRING_ELT(PATH, 0));
+  if (XLENGTH(SGM) != (R_xlen_t) N * N || XLENGTH(PHI) != n_unique3(N) || XLENGTH(PSI) != n_unique4(N))
+    error("the moments have inconsistent dimensions.");
+  momfile_header h;
+  momfile_layout(&h, N, asInteger(TT) == NA_INTEGER ? -1 : asInteger(TT));
+  if (!isNull(SCALE)) {
+    h.adjusted = 1;
+    for (int k = 0; k < 4; k++) h.scale[k] = REAL(SCALE)[k];
+  }
+
+  momfile_map *m = momfile_open(path, 1, momfile_size(&h));
+  SEXP map_ptr = PROTECT(R_MakeExternalPtr(m, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(map_ptr, momfile_map_finalizer, TRUE);
+  SEXP src[4] = {MU, SGM, PHI, PSI};
+  for (int k = 0; k < 4; k++)
+    memcpy((char *) m->addr + h.offset[k], REAL(src[k]), sizeof(double) * h.length[k]);
+  momfile_finish(m, &h);
+
+  momfile_close(m);
+  R_ClearExternalPtr(map_ptr);
+  UNPROTECT(1);
+  return R_NilValue;
+}
+
+SEXP  moments_file_read(SEXP PATH, SEXP VERIFY){
+  /*
+   arguments
+   PATH      : string, moments file
+   VERIFY    : logical, whether to verify the checksum (reads the whole file)
+
+   returns a list with mu, Sgm, Phi, and Psi viewing the mapped file, and the header fields
+   */
+
+  const char *path = CHAR(STRING_ELT(PATH, 0));
+  momfile_map *m = momfile_open(path, 0, 0);
+  SEXP map_ptr = PROTECT(R_MakeExternalPtr(m, install("momfile_map"), R_NilValue));
+  R_RegisterCFinalizerEx(map_ptr, momfile_map_finalizer, TRUE);
+  momfile_header h;
+  if (m->size >= sizeof(momfile_header)) memcpy(&h, m->addr, sizeof(momfile_header));
+  else memset(&h, 0, sizeof(momfile_header));
+  momfile_check_header(&h, m->size, path);
+  if (asLogical(VERIFY) && momfile_checksum(&h, (const char *) m->addr) != h.checksum)
+    error("checksum mismatch: file '%s' is corrupted.", path);
+
+  const char *names[] = {"mu", "Sgm", "Phi", "Psi", "T", "scale", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  for (int k = 0; k < 4; k++) SET_VECTOR_ELT(res, k, mmap_real_section(map_ptr, &h, k));
+  SEXP dim = PROTECT(allocVector(INTSXP, 2));
+  INTEGER(dim)[0] = INTEGER(dim)[1] = (int) h.N;
+  setAttrib(VECTOR_ELT(res, 1), R_DimSymbol, dim);
+  SET_VECTOR_ELT(res, 4, ScalarInteger(h.T < 0 ? NA_INTEGER : (int) h.T));
+  if (h.adjusted) {
+    SEXP scale = SET_VECTOR_ELT(res, 5, allocVector(REALSXP, 4));
+    for (int k = 0; k < 4; k++) REAL(scale)[k] = h.scale[k];
+  }
+  UNPROTECT(3);
+  return res;
+}
@@ -0,0 +1,371 @@
+// Portfolio derivative kernels working directly on the packed co-moments.
+//
+// The kernels themselves are in port_kernels_body.h, compiled once for packed elements in double
+// precision and once in single precision (accumulating in double); the functions at the end of
+// this file dispatch on the storage of the co-moments (see hop_comoment in highOrderPortfolios.h).
+//
+// For a unique element of the co-skewness (co-kurtosis) tensor with sorted indices, every
+// ordered pair of positions (p, q) contributes to entry (idx[p], idx[q]) of the matrix
+// Phi*w (Psi*(w x w)), weighted by the remaining weights and divided by the number of
+// index permutations that leave the element unchanged (sym). Only the upper triangle is
+// accumulated and mirrored at the end.
+
+#include "highOrderPortfolios.h"
+#include <math.h>
+
+// number of index permutations leaving an element invariant, indexed by the equality
+// pattern (ii==jj) + 2*(jj==kk) + 4*(kk==ll)
+static const double sym4[8] = {1.0, 2.0, 2.0, 6.0, 2.0, 4.0, 6.0, 24.0};
+static const double sym3[4] = {1.0, 2.0, 2.0, 6.0};
+
+// reduce the per-thread upper triangles into H and mirror it
+static void reduce_upper(double *H, const double *acc, int nthreads, int P) {
+  for (int jj = 0; jj < P; jj++)
+    for (int ii = 0; ii <= jj; ii++) {
+      double s = 0.0;
+      for (int th = 0; th < nthreads; th++) s += acc[(R_xlen_t)th * P * P + (R_xlen_t)jj * P + ii];
+      H[(R_xlen_t)jj * P + ii] = s;
+      H[(R_xlen_t)ii * P + jj] = s;
+    }
+}
+
+// the bounds of the Hessian kernels: running maximum of a pair, and the largest row sum of the reduction of
+// the per-thread accumulators (upper triangles of maxima, mirrored, or row sums)
+static inline void bound_max(double *u, double v) { if (v > *u) *u = v; }
+
+static double hess_bound_reduce(const double *acc, int nthreads, int P, int use_max) {
+  double *row = (double *) R_alloc(P, sizeof(double));
+  memset(row, 0, sizeof(double) * P);
+  if (use_max) {
+    for (int jj = 0; jj < P; jj++)
+      for (int ii = 0; ii <= jj; ii++) {
+        double m = 0.0;
+        for (int th = 0; th < nthreads; th++) {
+          double v = acc[(R_xlen_t)th * P * P + (R_xlen_t)jj * P + ii];
+          if (v > m) m = v;
+        }
+        row[ii] += m;
+        if (ii != jj) row[jj] += m;
+      }
+  } else {
+    for (int th = 0; th < nthreads; th++)
+      for (int ii = 0; ii < P; ii++) row[ii] += acc[(R_xlen_t)th * P + ii];
+  }
+  double bound = 0.0;
+  for (int ii = 0; ii < P; ii++) if (row[ii] > bound) bound = row[ii];
+  return bound;
+}
+
+// Branch-free portfolio skewness/kurtosis (and gradient) kernels.
+//
+// For fixed leading indices, the packed elements along the last index form a contiguous run.
+// Only the first element of the run (last index equal to the previous one) has a different
+// multiplicity, so the rest of the run reduces to a dot product with W (and an axpy for the
+// gradient), which is vectorized; the runs are distributed across threads by leading index.
+
+// the dot/axpy over a run are compiled for several instruction sets and dispatched at load time
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define HOP_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define HOP_TARGET_CLONES
+#endif
+
+// multiplicities of the first element and of the rest of a run, indexed by (ii==jj) [+ 2*(jj==kk)]
+static const double M3_run_coef[2][2] = {{3.0, 6.0}, {1.0, 3.0}};
+static const double M4_run_coef[4][2] = {{12.0, 24.0}, {6.0, 12.0}, {4.0, 12.0}, {1.0, 4.0}};
+
+// Batched portfolio skewness/kurtosis for the K columns of a weight matrix.
+//
+// The weights are interleaved so that every element of a packed run is loaded once and applied to
+// all K portfolios at the same time (as in a matrix product): the co-moments are read in a single
+// pass. Threads work on different slabs (first index ii) of the packed tensors, each accumulating
+// the moments of all K portfolios, summed at the end.
+
+// the kernels for packed elements stored in double and in single precision
+#define HOP_ELT double
+#define HOP_FN(name) name
+#include "port_kernels_body.h"
+#undef HOP_ELT
+#undef HOP_FN
+#define HOP_ELT float
+#define HOP_FN(name) name ## _f
+#include "port_kernels_body.h"
+#undef HOP_ELT
+#undef HOP_FN
+
+// Dispatch on the storage of the co-moments: packed (double or single precision), implied by the
+// centered returns (storage.c), or by a factor model (factor.c).
+
+double hop_port_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *grad) {
+  switch (X->kind) {
+  case HOP_PACKED_FLOAT:
+    return (X->order == 3) ? M3port_kernel_f(X->xf, W, P, nthreads, grad) : M4port_kernel_f(X->xf, W, P, nthreads, grad);
+  case HOP_LOWRANK:
+    return lowrank_port_kernel(X, W, P, grad);
+  case HOP_FACTOR:
+    return factor_port_kernel(X, W, P, grad);
+  default:
+    return (X->order == 3) ? M3port_kernel(X->x, W, P, nthreads, grad) : M4port_kernel(X->x, W, P, nthreads, grad);
+  }
+}
+
+void hop_port_hess_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *H) {
+  switch (X->kind) {
+  case HOP_PACKED_FLOAT:
+    if (X->order == 3) M3port_hess_kernel_f(X->xf, W, P, nthreads, H);
+    else M4port_hess_kernel_f(X->xf, W, P, nthreads, H);
+    break;
+  case HOP_LOWRANK:
+    lowrank_port_hess_kernel(X, W, P, nthreads, H);
+    break;
+  case HOP_FACTOR:
+    factor_port_hess_kernel(X, W, P, nthreads, H);
+    break;
+  default:
+    if (X->order == 3) M3port_hess_kernel(X->x, W, P, nthreads, H);
+    else M4port_hess_kernel(X->x, W, P, nthreads, H);
+  }
+}
+
+void hop_port_batch_kernel(const hop_comoment *X3, const hop_comoment *X4, const double *W, int P, int K,
+                           int nthreads, double *skew, double *kurt) {
+  if (X3->kind == HOP_PACKED && X4->kind == HOP_PACKED)
+    port_batch_kernel(X3->x, X4->x, W, P, K, nthreads, skew, kurt);
+  else if (X3->kind == HOP_PACKED_FLOAT && X4->kind == HOP_PACKED_FLOAT)
+    port_batch_kernel_f(X3->xf, X4->xf, W, P, K, nthreads, skew, kurt);
+  else if (X3->kind == HOP_LOWRANK && X4->kind == HOP_LOWRANK)
+    lowrank_port_batch_kernel(X3, X4, W, P, K, nthreads, skew, kurt);
+  else
+    for (int k = 0; k < K; k++) {
+      skew[k] = hop_port_kernel(X3, W + (R_xlen_t)k * P, P, nthreads, NULL);
+      kurt[k] = hop_port_kernel(X4, W + (R_xlen_t)k * P, P, nthreads, NULL);
+    }
+}
+
+// largest row sum of the unfolded |X| after the maximum (use_max) or the sum over its last indices, see
+// comoments_hess_bound()
+double hop_hess_bound(const hop_comoment *X, int P, int use_max, int nthreads) {
+  switch (X->kind) {
+  case HOP_PACKED_FLOAT:
+    return (X->order == 3) ? M3_hess_bound_kernel_f(X->xf, P, use_max, nthreads) : M4_hess_bound_kernel_f(X->xf, P, use_max, nthreads);
+  case HOP_PACKED:
+    return (X->order == 3) ? M3_hess_bound_kernel(X->x, P, use_max, nthreads) : M4_hess_bound_kernel(X->x, P, use_max, nthreads);
+  default:
+    error("the bounds need the packed co-moments.");
+  }
+}
+
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+// returns list(grad = scale_grad * H*w, hess = scale_hess * H)
+static SEXP port_derivs_list(double *H, const double *W, int P, double scale_grad, double scale_hess) {
+  const char *names[] = {"grad", "hess", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  SEXP grad = SET_VECTOR_ELT(res, 0, allocVector(REALSXP, P));
+  SEXP hess = SET_VECTOR_ELT(res, 1, allocMatrix(REALSXP, P, P));
+  double *rgrad = REAL(grad), *rhess = REAL(hess);
+  for (int ii = 0; ii < P; ii++) rgrad[ii] = 0.0;
+  for (int jj = 0; jj < P; jj++)
+    for (int ii = 0; ii < P; ii++) {
+      double h = H[(R_xlen_t)jj * P + ii];
+      rgrad[ii] += scale_grad * h * W[jj];
+      rhess[(R_xlen_t)jj * P + ii] = scale_hess * h;
+    }
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP  M3port_derivs(SEXP WW, SEXP XX, SEXP PP, SEXP NTHREADS){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : unique elements of a coskewness matrix (in any storage, see hop_comoment)
+   PP        : integer, number of assets
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the gradient and Hessian of the portfolio skewness in a single pass over XX
+   */
+
+  int P = asInteger(PP);
+  int nthreads = hop_num_threads(asInteger(NTHREADS));
+  hop_comoment X = hop_comoment_get(XX, 3, P);
+  double *A = (double *) R_alloc((size_t)P * P, sizeof(double));
+  hop_port_hess_kernel(&X, REAL(WW), P, nthreads, A);
+  return port_derivs_list(A, REAL(WW), P, 3.0, 6.0);
+}
+
+SEXP  M4port_derivs(SEXP WW, SEXP XX, SEXP PP, SEXP NTHREADS){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : unique elements of a cokurtosis matrix (in any storage, see hop_comoment)
+   PP        : integer, number of assets
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the gradient and Hessian of the portfolio kurtosis in a single pass over XX
+   */
+
+  int P = asInteger(PP);
+  int nthreads = hop_num_threads(asInteger(NTHREADS));
+  hop_comoment X = hop_comoment_get(XX, 4, P);
+  double *B = (double *) R_alloc((size_t)P * P, sizeof(double));
+  hop_port_hess_kernel(&X, REAL(WW), P, nthreads, B);
+  return port_derivs_list(B, REAL(WW), P, 4.0, 12.0);
+}
+
+
+static SEXP port_valgrad(SEXP WW, SEXP XX, SEXP PP, SEXP GRAD, SEXP NTHREADS, int order) {
+  int P = asInteger(PP);
+  int nthreads = hop_num_threads(asInteger(NTHREADS));
+  int with_grad = asLogical(GRAD);
+
+  const char *names[] = {"value", "grad", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  double *grad = NULL;
+  if (with_grad) grad = REAL(SET_VECTOR_ELT(res, 1, allocVector(REALSXP, P)));
+  hop_comoment X = hop_comoment_get(XX, order, P);
+  double val = hop_port_kernel(&X, REAL(WW), P, nthreads, grad);
+  SET_VECTOR_ELT(res, 0, ScalarReal(val));
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP  M3port_valgrad(SEXP WW, SEXP XX, SEXP PP, SEXP GRAD, SEXP NTHREADS){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : unique elements of a coskewness matrix (in any storage, see hop_comoment)
+   PP        : integer, number of assets
+   GRAD      : logical, whether to compute the gradient as well
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the portfolio skewness and (optionally) its gradient in a single pass over XX
+   */
+  return port_valgrad(WW, XX, PP, GRAD, NTHREADS, 3);
+}
+
+SEXP  M4port_valgrad(SEXP WW, SEXP XX, SEXP PP, SEXP GRAD, SEXP NTHREADS){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : unique elements of a cokurtosis matrix (in any storage, see hop_comoment)
+   PP        : integer, number of assets
+   GRAD      : logical, whether to compute the gradient as well
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the portfolio kurtosis and (optionally) its gradient in a single pass over XX
+   */
+  return port_valgrad(WW, XX, PP, GRAD, NTHREADS, 4);
+}
+
+// the entry points of PerformanceAnalytics (value or gradient only), on the same kernels
+static SEXP port_value(SEXP WW, SEXP XX, SEXP PP, int order) {
+  int P = asInteger(PP);
+  hop_comoment X = hop_comoment_get(XX, order, P);
+  return ScalarReal(hop_port_kernel(&X, REAL(WW), P, hop_num_threads(0), NULL));
+}
+
+static SEXP port_grad(SEXP WW, SEXP XX, SEXP PP, int order) {
+  int P = asInteger(PP);
+  hop_comoment X = hop_comoment_get(XX, order, P);
+  SEXP grad = PROTECT(allocVector(REALSXP, P));
+  hop_port_kernel(&X, REAL(WW), P, hop_num_threads(0), REAL(grad));
+  UNPROTECT(1);
+  return grad;
+}
+
+SEXP  M3port(SEXP WW, SEXP XX, SEXP PP){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : numeric vector with unique elements of a coskewness matrix
+   PP        : integer, number of assets
+
+   returns the portfolio skewness
+   */
+  return port_value(WW, XX, PP, 3);
+}
+
+SEXP  M3port_grad(SEXP WW, SEXP XX, SEXP PP){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : numeric vector with unique elements of a coskewness matrix
+   PP        : integer, number of assets
+
+   returns the gradient of the portfolio skewness
+   */
+  return port_grad(WW, XX, PP, 3);
+}
+
+SEXP  M4port(SEXP WW, SEXP XX, SEXP PP){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : numeric vector with unique elements of a cokurtosis matrix
+   PP        : integer, number of assets
+
+   returns the portfolio kurtosis
+   */
+  return port_value(WW, XX, PP, 4);
+}
+
+SEXP  M4port_grad(SEXP WW, SEXP XX, SEXP PP){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : numeric vector with unique elements of a cokurtosis matrix
+   PP        : integer, number of assets
+
+   returns the gradient of the portfolio kurtosis
+   */
+  return port_grad(WW, XX, PP, 4);
+}
+
+
+SEXP  M34port_batch(SEXP WW, SEXP XX3, SEXP XX4, SEXP PP, SEXP NTHREADS){
+  /*
+   arguments
+   WW        : numeric N x K matrix with one portfolio per column
+   XX3       : unique elements of a coskewness matrix (in any storage, see hop_comoment)
+   XX4       : unique elements of a cokurtosis matrix (in any storage, see hop_comoment)
+   PP        : integer, number of assets
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns a K x 2 matrix with the skewness and kurtosis of each portfolio
+   */
+
+  int P = asInteger(PP);
+  int K = (int)(XLENGTH(WW) / (P > 0 ? P : 1));
+  SEXP res = PROTECT(allocMatrix(REALSXP, K, 2));
+  hop_comoment X3 = hop_comoment_get(XX3, 3, P), X4 = hop_comoment_get(XX4, 4, P);
+  hop_port_batch_kernel(&X3, &X4, REAL(WW), P, K, hop_num_threads(asInteger(NTHREADS)), REAL(res), REAL(res) + K);
+  UNPROTECT(1);
+  return res;
+}
+
+
+SEXP  comoments_hess_bound(SEXP XX, SEXP ORDER, SEXP PP, SEXP FUNC, SEXP NTHREADS){
+  /*
+   arguments
+   XX        : unique elements of a coskewness or cokurtosis matrix (packed, in double or single precision)
+   ORDER     : integer, 3 (coskewness) or 4 (cokurtosis)
+   PP        : integer, number of assets
+   FUNC      : string, "max" or "sum"
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the largest row sum of |XX| unfolded as an N x N^(ORDER-1) matrix, after the maximum ("max")
+   or the sum ("sum") over the last ORDER-2 indices: times 6 (ORDER 3) or 12 (ORDER 4), a bound of the
+   largest eigenvalue of the Hessian of the portfolio skewness or kurtosis over the simplex
+   */
+
+  int P = asInteger(PP), order = asInteger(ORDER);
+  int nthreads = hop_num_threads(asInteger(NTHREADS));
+  int use_max = strcmp(CHAR(STRING_ELT(FUNC, 0)), "max") == 0;
+  hop_comoment X = hop_comoment_get(XX, order, P);
+  return ScalarReal(hop_hess_bound(&X, P, use_max, nthreads));
+}
+
+#endif
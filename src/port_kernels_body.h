@@ -0,0 +1,317 @@
+// Portfolio derivative kernels over the packed co-moments, for one element type.
+//
+// This file is included by port_kernels.c once per storage precision of the packed elements,
+// with HOP_ELT the element type (double or float) and HOP_FN(name) the name of each function
+// for that type. All the accumulations are done in double precision.
+
+// A = Phi*w (N x N), such that the Hessian of the portfolio skewness is 6*A and its gradient 3*A*w
+void HOP_FN(M3port_hess_kernel)(const HOP_ELT *X, const double *W, int P, int nthreads, double *A) {
+  double *acc = (double *) R_alloc((size_t)nthreads * P * P, sizeof(double));
+  memset(acc, 0, sizeof(double) * (size_t)nthreads * P * P);
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *U = acc + (R_xlen_t)omp_get_thread_num() * P * P;
+#else
+    double *U = acc;
+#endif
+    R_xlen_t iter = M3_index(P, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        double c = X[iter++] / sym3[(ii == jj) + 2 * (jj == kk)];
+        U[(R_xlen_t)jj * P + ii] += (1 + (ii == jj)) * c * W[kk];
+        U[(R_xlen_t)kk * P + ii] += (1 + (ii == kk)) * c * W[jj];
+        U[(R_xlen_t)kk * P + jj] += (1 + (jj == kk)) * c * W[ii];
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  reduce_upper(A, acc, nthreads, P);
+}
+
+// B = Psi*(w x w) (N x N), such that the Hessian of the portfolio kurtosis is 12*B and its gradient 4*B*w
+void HOP_FN(M4port_hess_kernel)(const HOP_ELT *X, const double *W, int P, int nthreads, double *B) {
+  double *acc = (double *) R_alloc((size_t)nthreads * P * P, sizeof(double));
+  memset(acc, 0, sizeof(double) * (size_t)nthreads * P * P);
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *U = acc + (R_xlen_t)omp_get_thread_num() * P * P;
+#else
+    double *U = acc;
+#endif
+    R_xlen_t iter = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        for (int ll = kk; ll < P; ll++) {
+          double c = 2.0 * X[iter++] / sym4[(ii == jj) + 2 * (jj == kk) + 4 * (kk == ll)];
+          U[(R_xlen_t)jj * P + ii] += (1 + (ii == jj)) * c * W[kk] * W[ll];
+          U[(R_xlen_t)kk * P + ii] += (1 + (ii == kk)) * c * W[jj] * W[ll];
+          U[(R_xlen_t)ll * P + ii] += (1 + (ii == ll)) * c * W[jj] * W[kk];
+          U[(R_xlen_t)kk * P + jj] += (1 + (jj == kk)) * c * W[ii] * W[ll];
+          U[(R_xlen_t)ll * P + jj] += (1 + (jj == ll)) * c * W[ii] * W[kk];
+          U[(R_xlen_t)ll * P + kk] += (1 + (kk == ll)) * c * W[ii] * W[jj];
+        } // loop ll
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  reduce_upper(B, acc, nthreads, P);
+}
+
+HOP_TARGET_CLONES
+static double HOP_FN(run_dot)(const HOP_ELT *x, const double *w, int n) {
+  double s = 0.0;
+  HOP_OMP(omp simd reduction(+:s))
+  for (int l = 0; l < n; l++) s += x[l] * w[l];
+  return s;
+}
+
+HOP_TARGET_CLONES
+static void HOP_FN(run_axpy)(double a, const HOP_ELT *x, double *g, int n) {
+  HOP_OMP(omp simd)
+  for (int l = 0; l < n; l++) g[l] += a * x[l];
+}
+
+// portfolio skewness w'*Phi*(w x w) and, if grad != NULL, its gradient
+double HOP_FN(M3port_kernel)(const HOP_ELT *X, const double *W, int P, int nthreads, double *grad) {
+  double val = 0.0;
+  double *acc = NULL;
+  if (grad) {
+    acc = (double *) R_alloc((size_t)nthreads * P, sizeof(double));
+    memset(acc, 0, sizeof(double) * (size_t)nthreads * P);
+  }
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads) reduction(+:val))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *g = grad ? acc + (R_xlen_t)omp_get_thread_num() * P : NULL;
+#else
+    double *g = acc;
+#endif
+    R_xlen_t iter = M3_index(P, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      const double *c = M3_run_coef[ii == jj];
+      const HOP_ELT *x = X + iter;
+      int n = P - jj - 1;
+      double m2 = W[ii] * W[jj];
+      double x0 = c[0] * x[0];
+      double q = c[1] * HOP_FN(run_dot)(x + 1, W + jj + 1, n) + x0 * W[jj];
+      val += m2 * q;
+      if (g) {
+        HOP_FN(run_axpy)(c[1] * m2, x + 1, g + jj + 1, n);
+        g[ii] += W[jj] * q;
+        g[jj] += W[ii] * q + m2 * x0;
+      }
+      iter += n + 1;
+    } // loop jj
+  } // loop ii
+
+  if (grad)
+    for (int ii = 0; ii < P; ii++) {
+      double s = 0.0;
+      for (int th = 0; th < nthreads; th++) s += acc[(R_xlen_t)th * P + ii];
+      grad[ii] = s;
+    }
+  return val;
+}
+
+// portfolio kurtosis w'*Psi*(w x w x w) and, if grad != NULL, its gradient
+double HOP_FN(M4port_kernel)(const HOP_ELT *X, const double *W, int P, int nthreads, double *grad) {
+  double val = 0.0;
+  double *acc = NULL;
+  if (grad) {
+    acc = (double *) R_alloc((size_t)nthreads * P, sizeof(double));
+    memset(acc, 0, sizeof(double) * (size_t)nthreads * P);
+  }
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads) reduction(+:val))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *g = grad ? acc + (R_xlen_t)omp_get_thread_num() * P : NULL;
+#else
+    double *g = acc;
+#endif
+    R_xlen_t iter = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        const double *c = M4_run_coef[(ii == jj) + 2 * (jj == kk)];
+        const HOP_ELT *x = X + iter;
+        int n = P - kk - 1;
+        double m3 = W[ii] * W[jj] * W[kk];
+        double x0 = c[0] * x[0];
+        double q = c[1] * HOP_FN(run_dot)(x + 1, W + kk + 1, n) + x0 * W[kk];
+        val += m3 * q;
+        if (g) {
+          HOP_FN(run_axpy)(c[1] * m3, x + 1, g + kk + 1, n);
+          g[ii] += W[jj] * W[kk] * q;
+          g[jj] += W[ii] * W[kk] * q;
+          g[kk] += W[ii] * W[jj] * q + m3 * x0;
+        }
+        iter += n + 1;
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  if (grad)
+    for (int ii = 0; ii < P; ii++) {
+      double s = 0.0;
+      for (int th = 0; th < nthreads; th++) s += acc[(R_xlen_t)th * P + ii];
+      grad[ii] = s;
+    }
+  return val;
+}
+
+static void HOP_FN(port_batch_kernel)(const HOP_ELT *Phi, const HOP_ELT *Psi, const double *W, int P, int K,
+                              int nthreads, double *skew, double *kurt) {
+  // interleaved weights Wt[ll*K + c] = W[c*P + ll], and per thread: the skewness and kurtosis of the K
+  // portfolios, the current run d, and the products m of the weights of its leading indices
+  double *Wt = (double *) R_alloc((size_t)P * K, sizeof(double));
+  double *acc = (double *) R_alloc((size_t)nthreads * 4 * K, sizeof(double));
+  memset(acc, 0, sizeof(double) * (size_t)nthreads * 4 * K);
+  for (int c = 0; c < K; c++)
+    for (int ll = 0; ll < P; ll++) Wt[(R_xlen_t)ll * K + c] = W[(R_xlen_t)c * P + ll];
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *s3 = acc + (R_xlen_t)omp_get_thread_num() * 4 * K;
+#else
+    double *s3 = acc;
+#endif
+    double *s4 = s3 + K, *d = s4 + K, *m = d + K;
+    const double *wi = Wt + (R_xlen_t)ii * K;
+
+    // skewness: the slab ii of Phi
+    R_xlen_t iter = M3_index(P, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      const double *cf = M3_run_coef[ii == jj];
+      const HOP_ELT *x = Phi + iter;
+      const double *wj = Wt + (R_xlen_t)jj * K;
+      memset(d, 0, sizeof(double) * K);
+      for (int kk = jj + 1; kk < P; kk++) {
+        double xv = x[kk - jj];
+        const double *wk = Wt + (R_xlen_t)kk * K;
+        HOP_OMP(omp simd)
+        for (int c = 0; c < K; c++) d[c] += xv * wk[c];
+      }
+      double x0 = cf[0] * x[0];
+      HOP_OMP(omp simd)
+      for (int c = 0; c < K; c++) s3[c] += wi[c] * wj[c] * (cf[1] * d[c] + x0 * wj[c]);
+      iter += P - jj;
+    } // loop jj
+
+    // kurtosis: the slab ii of Psi
+    iter = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      const double *wj = Wt + (R_xlen_t)jj * K;
+      HOP_OMP(omp simd)
+      for (int c = 0; c < K; c++) m[c] = wi[c] * wj[c];
+      for (int kk = jj; kk < P; kk++) {
+        const double *cf = M4_run_coef[(ii == jj) + 2 * (jj == kk)];
+        const HOP_ELT *x = Psi + iter;
+        const double *wk = Wt + (R_xlen_t)kk * K;
+        memset(d, 0, sizeof(double) * K);
+        for (int ll = kk + 1; ll < P; ll++) {
+          double xv = x[ll - kk];
+          const double *wl = Wt + (R_xlen_t)ll * K;
+          HOP_OMP(omp simd)
+          for (int c = 0; c < K; c++) d[c] += xv * wl[c];
+        }
+        double x0 = cf[0] * x[0];
+        HOP_OMP(omp simd)
+        for (int c = 0; c < K; c++) s4[c] += m[c] * wk[c] * (cf[1] * d[c] + x0 * wk[c]);
+        iter += P - kk;
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  for (int c = 0; c < K; c++) {
+    double a = 0.0, b = 0.0;
+    for (int th = 0; th < nthreads; th++) {
+      a += acc[(R_xlen_t)th * 4 * K + c];
+      b += acc[(R_xlen_t)th * 4 * K + K + c];
+    }
+    skew[c] = a;
+    kurt[c] = b;
+  }
+}
+
+// Row bounds of |Phi| (|Psi|) unfolded as an N x N^2 (N x N^3) matrix, giving the bounds of the largest
+// eigenvalue of the Hessian of the portfolio skewness (kurtosis) of .maxEigHsnS() (.maxEigHsnK()) in one
+// sweep over the unique elements. With use_max, each element updates the maximum over the remaining indices
+// of every pair of its positions (a per-thread upper triangle); otherwise it adds |x| times the number of its
+// permutations starting with each position to that row (a per-thread row accumulator).
+static double HOP_FN(M3_hess_bound_kernel)(const HOP_ELT *X, int P, int use_max, int nthreads) {
+  R_xlen_t len = use_max ? (R_xlen_t)P * P : P;
+  double *acc = (double *) R_alloc((size_t)nthreads * len, sizeof(double));
+  memset(acc, 0, sizeof(double) * (size_t)nthreads * len);
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *U = acc + (R_xlen_t)omp_get_thread_num() * len;
+#else
+    double *U = acc;
+#endif
+    R_xlen_t iter = M3_index(P, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        double v = fabs((double) X[iter++]);
+        if (use_max) {
+          bound_max(U + (R_xlen_t)jj * P + ii, v);
+          bound_max(U + (R_xlen_t)kk * P + ii, v);
+          bound_max(U + (R_xlen_t)kk * P + jj, v);
+        } else {
+          v *= 2.0 / sym3[(ii == jj) + 2 * (jj == kk)];
+          U[ii] += v;
+          U[jj] += v;
+          U[kk] += v;
+        }
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  return hess_bound_reduce(acc, nthreads, P, use_max);
+}
+
+static double HOP_FN(M4_hess_bound_kernel)(const HOP_ELT *X, int P, int use_max, int nthreads) {
+  R_xlen_t len = use_max ? (R_xlen_t)P * P : P;
+  double *acc = (double *) R_alloc((size_t)nthreads * len, sizeof(double));
+  memset(acc, 0, sizeof(double) * (size_t)nthreads * len);
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+#ifdef _OPENMP
+    double *U = acc + (R_xlen_t)omp_get_thread_num() * len;
+#else
+    double *U = acc;
+#endif
+    R_xlen_t iter = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        for (int ll = kk; ll < P; ll++) {
+          double v = fabs((double) X[iter++]);
+          if (use_max) {
+            bound_max(U + (R_xlen_t)jj * P + ii, v);
+            bound_max(U + (R_xlen_t)kk * P + ii, v);
+            bound_max(U + (R_xlen_t)ll * P + ii, v);
+            bound_max(U + (R_xlen_t)kk * P + jj, v);
+            bound_max(U + (R_xlen_t)ll * P + jj, v);
+            bound_max(U + (R_xlen_t)ll * P + kk, v);
+          } else {
+            v *= 6.0 / sym4[(ii == jj) + 2 * (jj == kk) + 4 * (kk == ll)];
+            U[ii] += v;
+            U[jj] += v;
+            U[kk] += v;
+            U[ll] += v;
+          }
+        } // loop ll
+      } // loop kk
+    } // loop jj
+  } // loop ii
+
+  return hess_bound_reduce(acc, nthreads, P, use_max);
+}
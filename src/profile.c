@@ -0,0 +1,12 @@
+// Clock of the opt-in profiling of the design functions (argument profile): the same wall-clock time as
+// the native loops (hop_time), with the resolution of the OpenMP timer instead of that of proc.time().
+
+#include "highOrderPortfolios.h"
+
+SEXP  hop_wtime(void){
+  /*
+   returns the wall-clock time in seconds (CPU time when OpenMP is not available)
+   */
+
+  return ScalarReal(hop_time());
+}
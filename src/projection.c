@@ -0,0 +1,155 @@
+// Euclidean projection onto the simplex {x >= 0, sum(x) == 1}, optionally with upper bounds
+// x <= ub. These are the whole per-iteration cost (besides the gradient) of the projected
+// gradient methods, so they avoid any allocation beyond the caller-provided workspace:
+//   - small N: sort-based method, O(N log N),
+//   - large N: Condat's method, O(N) expected (L. Condat, "Fast projection onto the simplex and
+//     the l1 ball," Mathematical Programming, vol. 158, pp. 575-585, 2016),
+//   - upper bounds: walk over the sorted breakpoints of the piecewise-linear sum(x(tau)).
+
+#include "highOrderPortfolios.h"
+
+#define SIMPLEX_PROJ_SORT_MAX 64
+
+// sort-based projection; work: N
+static void simplex_project_sort(int N, const double *y, double *x, double *work) {
+  for (int i = 0; i < N; i++) work[i] = y[i];
+  R_rsort(work, N);  // ascending
+  double s = 0.0, tau = 0.0;
+  for (int k = 1; k <= N; k++) {
+    double u = work[N - k];
+    s += u;
+    double t = (s - 1.0) / k;
+    if (u - t > 0) tau = t;
+    else break;
+  }
+  for (int i = 0; i < N; i++) {
+    double v = y[i] - tau;
+    x[i] = v > 0 ? v : 0.0;
+  }
+}
+
+// Condat's projection; work: 2N
+static void simplex_project_condat(int N, const double *y, double *x, double *work) {
+  double *v = work, *vt = work + N;
+  int nv = 1, nvt = 0;
+  v[0] = y[0];
+  double rho = y[0] - 1.0;
+  for (int n = 1; n < N; n++) {
+    double yn = y[n];
+    if (yn > rho) {
+      rho += (yn - rho) / (nv + 1);
+      if (rho > yn - 1.0) {
+        v[nv++] = yn;
+      } else {
+        for (int k = 0; k < nv; k++) vt[nvt++] = v[k];
+        v[0] = yn;
+        nv = 1;
+        rho = yn - 1.0;
+      }
+    }
+  }
+  for (int k = 0; k < nvt; k++)
+    if (vt[k] > rho) {
+      v[nv++] = vt[k];
+      rho += (vt[k] - rho) / nv;
+    }
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    int m = 0;
+    for (int k = 0; k < nv; k++) {
+      if (v[k] <= rho && nv - (k - m) > 1) {
+        int left = nv - (k - m) - 1;  // size of v after this removal
+        rho += (rho - v[k]) / left;
+        changed = 1;
+      } else {
+        v[m++] = v[k];
+      }
+    }
+    nv = m;
+  }
+  for (int i = 0; i < N; i++) {
+    double d = y[i] - rho;
+    x[i] = d > 0 ? d : 0.0;
+  }
+}
+
+void simplex_project(int N, const double *y, double *x, double *work) {
+  if (N <= SIMPLEX_PROJ_SORT_MAX) simplex_project_sort(N, y, x, work);
+  else simplex_project_condat(N, y, x, work);
+}
+
+// projection onto {0 <= x <= ub, sum(x) == 1}, x_i = min(max(y_i - tau, 0), ub_i); work: 2N, iwork: 2N
+// (sum(ub) >= 1 is assumed; otherwise x = ub)
+void simplex_project_box(int N, const double *y, const double *ub, double *x, double *work, int *iwork) {
+  // breakpoints, in decreasing order: at tau = y_i variable i becomes positive, at
+  // tau = y_i - ub_i it reaches its upper bound
+  for (int i = 0; i < N; i++) {
+    work[i] = -y[i];
+    work[N + i] = -(y[i] - ub[i]);
+    iwork[i] = i;
+    iwork[N + i] = N + i;
+  }
+  rsort_with_index(work, iwork, 2 * N);
+
+  double f = 0.0, slope = 0.0, tau = -work[0];
+  int k;
+  for (k = 0; k < 2 * N; k++) {
+    double t = -work[k];
+    double f_next = f + slope * (tau - t);
+    if (f_next >= 1.0) break;
+    f = f_next;
+    tau = t;
+    slope += iwork[k] < N ? 1.0 : -1.0;
+  }
+  if (k < 2 * N) tau -= (1.0 - f) / slope;  // slope > 0 here since f < 1 <= f_next
+
+  for (int i = 0; i < N; i++) {
+    double v = y[i] - tau;
+    x[i] = v < 0 ? 0.0 : (v > ub[i] ? ub[i] : v);
+  }
+}
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+SEXP  project_simplex(SEXP YY, SEXP UB, SEXP NTHREADS){
+  /*
+   arguments
+   YY        : numeric vector, or N x K matrix with one vector per column
+   UB        : NULL, or numeric vector of length N with upper bounds
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the projection(s) of YY onto the simplex (intersected with the box [0, UB])
+   */
+
+  int N = isMatrix(YY) ? nrows(YY) : LENGTH(YY);
+  int K = isMatrix(YY) ? ncols(YY) : 1;
+  const double *ub = isNull(UB) ? NULL : REAL(UB);
+  if (ub) {
+    if (LENGTH(UB) != N) error("the upper bounds must have one element per asset.");
+    double s = 0.0;
+    for (int i = 0; i < N; i++) s += ub[i];
+    if (s < 1.0) error("infeasible projection: the upper bounds sum to less than 1.");
+  }
+  SEXP res = PROTECT(duplicate(YY));
+  const double *y = REAL(YY);
+  double *x = REAL(res);
+  int nthreads = K > 1 ? hop_num_threads(asInteger(NTHREADS)) : 1;
+
+  // per-thread scratch, taken before the parallel region
+  double *work_all = (double *) R_alloc(2 * (size_t)N * nthreads, sizeof(double));
+  int *iwork_all = (int *) R_alloc(2 * (size_t)N * nthreads, sizeof(int));
+  HOP_OMP(omp parallel for schedule(static) num_threads(nthreads))
+  for (int k = 0; k < K; k++) {
+    double *work = work_all + 2 * (R_xlen_t)N * omp_get_thread_num();
+    int *iwork = iwork_all + 2 * (R_xlen_t)N * omp_get_thread_num();
+    if (ub) simplex_project_box(N, y + (R_xlen_t)k * N, ub, x + (R_xlen_t)k * N, work, iwork);
+    else simplex_project(N, y + (R_xlen_t)k * N, x + (R_xlen_t)k * N, work);
+  }
+
+  UNPROTECT(1);
+  return res;
+}
+
+#endif
@@ -0,0 +1,444 @@
+// Projection of a symmetric matrix onto the PSD cone along the SCA iterations.
+//
+// The Hessian approximations of Q-MVSK and Q-MVSKT need H+ = V diag(max(d, 0)) V' (and a factor L
+// with L L' = H+ for the SOCP formulation) of a matrix that changes smoothly from one iteration to
+// the next. Only the eigenpairs of the smaller of the positive and negative eigenspaces are needed:
+// H+ = V+ D+ V+' from the positive ones, or H+ = H - V- D- V-' from the negative ones, and then L
+// from the Cholesky factorization of H+ with complete pivoting (e.g., the Hessian of the kurtosis in
+// Q-MVSKT is positive semidefinite, so that no eigenpair is needed at all). Their number comes from
+// the inertia of the LDL' factorization of H, and the tracker keeps them together with a few guard
+// eigenvectors of the other sign from one call to the next. They are first refined for the new
+// matrix by a block LOBPCG warm-started from the last call (preconditioned by the same LDL'
+// factorization), accepted only when all the wanted Ritz pairs have converged and their number
+// matches the inertia, so that no eigenvalue that changed sign far from the tracked subspace is
+// missed. Otherwise, or when the refinement would cost about as much, only the wanted eigenpairs and
+// the guards are computed by a partial eigendecomposition, which resets the tracked subspace. A
+// spectrum split about evenly between both signs is not tracked (the refinement would cost as much as
+// the full eigendecomposition).
+
+#define USE_FC_LEN_T
+#include "highOrderPortfolios.h"
+#ifndef HOP_STANDALONE
+#include <R_ext/Lapack.h>
+#endif
+#include <math.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+#define PSD_GUARD 4       // minimum number of guard eigenvectors
+#define PSD_TOL 1e-12     // convergence of the residuals, relative to the Frobenius norm of the matrix
+#define PSD_MAXIT 20
+
+psd_tracker *psd_alloc(int N) {
+  psd_tracker *t = R_Calloc(1, psd_tracker);
+  t->N = N;
+  t->X = R_Calloc((size_t)N * N, double);
+  t->P = R_Calloc((size_t)N * N, double);
+  return t;
+}
+
+void psd_free(psd_tracker *t) {
+  if (!t) return;
+  R_Free(t->X); R_Free(t->P);
+  R_Free(t);
+}
+
+// all the eigenpairs of the n x n symmetric A (lower triangle, destroyed), in ascending order
+static void sym_eig(int n, double *A, double *d, double *Z) {
+  int m, info, lwork = -1, liwork = -1, iwkopt, il = 0, iu = 0;
+  double vl = 0.0, vu = 0.0, abstol = 0.0, wkopt;
+  int *isuppz = (int *) R_alloc(2 * (size_t)n, sizeof(int));
+  F77_CALL(dsyevr)("V", "A", "L", &n, A, &n, &vl, &vu, &il, &iu, &abstol, &m, d, Z, &n, isuppz,
+                   &wkopt, &lwork, &iwkopt, &liwork, &info FCONE FCONE FCONE);
+  lwork = (int) wkopt;
+  liwork = iwkopt;
+  double *work = (double *) R_alloc(lwork, sizeof(double));
+  int *iwork = (int *) R_alloc(liwork, sizeof(int));
+  F77_CALL(dsyevr)("V", "A", "L", &n, A, &n, &vl, &vu, &il, &iu, &abstol, &m, d, Z, &n, isuppz,
+                   work, &lwork, iwork, &liwork, &info FCONE FCONE FCONE);
+  if (info != 0) error("eigendecomposition failed in the PSD approximation (info = %d).", info);
+}
+
+// the eigenpairs il, ..., iu (1-based, in ascending order) of the N x N symmetric H (lower triangle)
+static void sym_eig_range(int N, const double *H, int il, int iu, double *d, double *Z) {
+  int m, info, lwork = -1, liwork = -1, iwkopt;
+  double vl = 0.0, vu = 0.0, abstol = 0.0, wkopt;
+  double *A = (double *) R_alloc((size_t)N * N, sizeof(double));
+  int *isuppz = (int *) R_alloc(2 * (size_t)N, sizeof(int));
+  memcpy(A, H, sizeof(double) * (size_t)N * N);
+  F77_CALL(dsyevr)("V", "I", "L", &N, A, &N, &vl, &vu, &il, &iu, &abstol, &m, d, Z, &N, isuppz,
+                   &wkopt, &lwork, &iwkopt, &liwork, &info FCONE FCONE FCONE);
+  lwork = (int) wkopt;
+  liwork = iwkopt;
+  double *work = (double *) R_alloc(lwork, sizeof(double));
+  int *iwork = (int *) R_alloc(liwork, sizeof(int));
+  F77_CALL(dsyevr)("V", "I", "L", &N, A, &N, &vl, &vu, &il, &iu, &abstol, &m, d, Z, &N, isuppz,
+                   work, &lwork, iwork, &liwork, &info FCONE FCONE FCONE);
+  if (info != 0) error("eigendecomposition failed in the PSD approximation (info = %d).", info);
+}
+
+// Bunch-Kaufman factorization H = L D L' of the symmetric H (lower triangle) into A and ipiv; returns
+// 0 if D is singular
+static int psd_ldl(int N, const double *H, double *A, int *ipiv) {
+  int info, lwork = -1;
+  double wkopt;
+  memcpy(A, H, sizeof(double) * (size_t)N * N);
+  F77_CALL(dsytrf)("L", &N, A, &N, ipiv, &wkopt, &lwork, &info FCONE);
+  lwork = (int) wkopt;
+  double *work = (double *) R_alloc(lwork, sizeof(double));
+  F77_CALL(dsytrf)("L", &N, A, &N, ipiv, work, &lwork, &info FCONE);
+  if (info < 0) error("LDL' factorization failed in the PSD approximation (info = %d).", info);
+  return info == 0;
+}
+
+// number of eigenvalues of sign s of H from the block-diagonal D of its LDL' factorization (Sylvester's
+// law of inertia)
+static int ldl_inertia(int N, const double *A, const int *ipiv, int s) {
+  int count = 0;
+  for (int k = 0; k < N; ) {
+    double a = A[(R_xlen_t)k * N + k];
+    if (ipiv[k] > 0 || k == N - 1) {
+      count += (s * a > 0);
+      k++;
+    } else {  // 2 x 2 block
+      double b = A[(R_xlen_t)k * N + k + 1], c = A[(R_xlen_t)(k + 1) * N + k + 1], det = a * c - b * b;
+      if (det < 0) count += 1;
+      else if (det > 0) count += 2 * (s * (a + c) > 0);
+      else count += (s * (a + c) > 0);
+      k += 2;
+    }
+  }
+  return count;
+}
+
+// orthonormalize the columns j0, ..., b - 1 of the N x b Q against the first j0 (orthonormal) and among
+// themselves (classical Gram-Schmidt, twice), dropping those numerically in the span of the previous
+// ones; returns the number of columns kept. The first nimg of them come with their products with H in
+// the same columns of HQ, which are updated alike (and in *nimg_kept, the number of those kept): they
+// are dropped as soon as they lose 3 digits, which the rounding errors of their products would gain.
+static int orth_columns(int N, double *Q, double *HQ, int j0, int b, int nimg, int *nimg_kept, double *work) {
+  int one = 1, nk = j0, ni = 0;
+  double done = 1.0, dzero = 0.0, dmone = -1.0;
+  for (int j = j0; j < b; j++) {
+    int img = (j - j0 < nimg);
+    double *q = Q + (R_xlen_t)nk * N, *hq = img ? HQ + (R_xlen_t)nk * N : NULL;
+    if (nk != j) {
+      memcpy(q, Q + (R_xlen_t)j * N, sizeof(double) * N);
+      if (img) memcpy(hq, HQ + (R_xlen_t)j * N, sizeof(double) * N);
+    }
+    double nrm0 = sqrt(F77_CALL(ddot)(&N, q, &one, q, &one));
+    if (nrm0 == 0.0) continue;
+    for (int pass = 0; pass < 2 && nk > 0; pass++) {
+      F77_CALL(dgemv)("T", &N, &nk, &done, Q, &N, q, &one, &dzero, work, &one FCONE);
+      F77_CALL(dgemv)("N", &N, &nk, &dmone, Q, &N, work, &one, &done, q, &one FCONE);
+      if (img) F77_CALL(dgemv)("N", &N, &nk, &dmone, HQ, &N, work, &one, &done, hq, &one FCONE);
+    }
+    double nrm = sqrt(F77_CALL(ddot)(&N, q, &one, q, &one));
+    if (nrm <= (img ? 1e-3 : 1e-10) * nrm0) continue;
+    double sc = 1.0 / nrm;
+    F77_CALL(dscal)(&N, &sc, q, &one);
+    if (img) {
+      F77_CALL(dscal)(&N, &sc, hq, &one);
+      ni++;
+    }
+    nk++;
+  }
+  if (nimg_kept) *nimg_kept = ni;
+  return nk;
+}
+
+// the wanted eigenpairs of sign s and the guards (the m columns of Z) become the tracked subspace if it is small
+static void psd_track(psd_tracker *t, const double *Z, int s, int m) {
+  int N = t->N;
+  t->side = (4 * m <= N) ? s : 0;
+  t->m = m;
+  t->has_P = 0;
+  if (t->side) memcpy(t->X, Z, sizeof(double) * (size_t)N * m);
+}
+
+// the eigenpairs at the end of sign s of the spectrum, by decreasing magnitude: column c of V is the
+// eigenpair n - 1 - c (positive side) or c (negative side) of the n in ascending order in d, Z
+static void psd_select(int N, int n, const double *d, const double *Z, int s, int m, double *lam, double *V) {
+  for (int c = 0; c < m; c++) {
+    int i = (s > 0) ? n - 1 - c : c;
+    lam[c] = d[i];
+    memcpy(V + (R_xlen_t)c * N, Z + (R_xlen_t)i * N, sizeof(double) * N);
+  }
+}
+
+// full eigendecomposition: the smaller side s and its k eigenpairs with the guards in lam, V; returns k
+static int psd_full(psd_tracker *t, const double *H, int *s, double *lam, double *V) {
+  int N = t->N;
+  double *A = (double *) R_alloc((size_t)N * N, sizeof(double));
+  double *d = (double *) R_alloc(N, sizeof(double));
+  double *Z = (double *) R_alloc((size_t)N * N, sizeof(double));
+  memcpy(A, H, sizeof(double) * (size_t)N * N);
+  sym_eig(N, A, d, Z);
+
+  int npos = 0, nneg = 0;
+  for (int i = 0; i < N; i++) {
+    npos += (d[i] > 0);
+    nneg += (d[i] < 0);
+  }
+  *s = (npos <= nneg) ? 1 : -1;
+  int k = (*s > 0) ? npos : nneg, g = (k / 4 > PSD_GUARD) ? k / 4 : PSD_GUARD, m = (k + g < N) ? k + g : N;
+  psd_select(N, N, d, Z, *s, m, lam, V);
+  psd_track(t, V, *s, m);
+  t->n_eig++;
+  return k;
+}
+
+// partial eigendecomposition, when the number k of eigenvalues of sign s is known (from the inertia):
+// only those eigenpairs and the guards, in lam, V; returns the number of eigenvalues of sign s
+static int psd_partial(psd_tracker *t, const double *H, int s, int k, double *lam, double *V) {
+  int N = t->N, g = (k / 4 > PSD_GUARD) ? k / 4 : PSD_GUARD, m = (k + g < N) ? k + g : N, nwanted;
+  double *d = (double *) R_alloc(N, sizeof(double));
+  double *Z = (double *) R_alloc((size_t)N * N, sizeof(double));
+  for (;;) {
+    if (s > 0) sym_eig_range(N, H, N - m + 1, N, d, Z);
+    else sym_eig_range(N, H, 1, m, d, Z);
+    nwanted = 0;
+    for (int i = 0; i < m; i++) nwanted += (s * d[i] > 0);
+    if (nwanted < m || m == N) break;
+    m = N;  // the inertia missed eigenvalues close to zero
+  }
+  psd_select(N, m, d, Z, s, m, lam, V);
+  psd_track(t, V, s, m);
+  t->n_eig++;
+  return nwanted;
+}
+
+// warm-started refinement of the tracked subspace for the new H; returns 0 if it has to be reset
+//
+// The basis of each Rayleigh-Ritz step is [X, P, R, H^-1 R] (Ritz vectors, the previous directions,
+// the unconverged residuals, and the same preconditioned by the LDL' factorization): the
+// multiplication by H converges the eigenvalues of large magnitude and the inverse the ones close to
+// zero, i.e., those at the boundary between the tracked eigenvectors and the guards. The products of
+// X and P with H follow from those of the previous basis, so that each step costs two products with H
+// and a solve per unconverged residual; the refinement stops at 2N of them, about the cost of the
+// partial eigendecomposition (whose reduction to tridiagonal form runs at the speed of products with
+// a vector).
+static int psd_refine(psd_tracker *t, const double *H, const double *F, const int *ipiv, int nsign,
+                      double *lam, double *V) {
+  int N = t->N, m = t->m, s = t->side, info;
+  double done = 1.0, dzero = 0.0;
+
+  double *Q = (double *) R_alloc(4 * (size_t)N * m, sizeof(double));
+  double *HQ = (double *) R_alloc(4 * (size_t)N * m, sizeof(double));
+  double *T1 = (double *) R_alloc((size_t)N * m, sizeof(double));
+  double *T2 = (double *) R_alloc((size_t)N * m, sizeof(double));
+  double *A = (double *) R_alloc(16 * (size_t)m * m, sizeof(double));
+  double *Z = (double *) R_alloc(16 * (size_t)m * m, sizeof(double));
+  double *Y = (double *) R_alloc(4 * (size_t)m * m, sizeof(double));
+  double *d = (double *) R_alloc(4 * (size_t)m, sizeof(double));
+  double *theta = (double *) R_alloc(m, sizeof(double));
+  double *work = (double *) R_alloc(4 * (size_t)m, sizeof(double));
+  double *HP = (double *) R_alloc((size_t)N * m, sizeof(double));
+
+  double hnorm = 0.0;
+  for (int j = 0; j < N; j++) {
+    hnorm += H[(R_xlen_t)j * N + j] * H[(R_xlen_t)j * N + j];
+    for (int i = j + 1; i < N; i++) hnorm += 2 * H[(R_xlen_t)j * N + i] * H[(R_xlen_t)j * N + i];
+  }
+  double tol = PSD_TOL * sqrt(hnorm);
+
+  // the previous Ritz vectors (reorthonormalized, as they drift over the calls) and the previous directions
+  memcpy(Q, t->X, sizeof(double) * (size_t)N * m);
+  if (orth_columns(N, Q, NULL, 0, m, 0, NULL, work) < m) return 0;
+  int b = m, cols = 0;
+  if (t->has_P) {
+    memcpy(Q + (R_xlen_t)m * N, t->P, sizeof(double) * (size_t)N * m);
+    b = orth_columns(N, Q, NULL, m, 2 * m, 0, NULL, work);
+  }
+  F77_CALL(dsymm)("L", "L", &N, &b, &done, H, &N, Q, &N, &dzero, HQ, &N FCONE FCONE);
+  cols += b;
+
+  int has_P = 0, converged = 0, nwanted = 0;
+  for (int it = 0; it < PSD_MAXIT; it++) {
+    // Rayleigh-Ritz on the span of Q: the m extreme Ritz pairs on the side s
+    F77_CALL(dgemm)("T", "N", &b, &b, &N, &done, Q, &N, HQ, &N, &dzero, A, &b FCONE FCONE);
+    for (int j = 0; j < b; j++)
+      for (int i = j + 1; i < b; i++) A[(R_xlen_t)j * b + i] = 0.5 * (A[(R_xlen_t)j * b + i] + A[(R_xlen_t)i * b + j]);
+    sym_eig(b, A, d, Z);
+    for (int c = 0; c < m; c++) {
+      int i = (s > 0) ? b - 1 - c : c;
+      theta[c] = d[i];
+      memcpy(Y + (R_xlen_t)c * b, Z + (R_xlen_t)i * b, sizeof(double) * b);
+    }
+    F77_CALL(dgemm)("N", "N", &N, &m, &b, &done, Q, &N, Y, &b, &dzero, T1, &N FCONE FCONE);
+    F77_CALL(dgemm)("N", "N", &N, &m, &b, &done, HQ, &N, Y, &b, &dzero, T2, &N FCONE FCONE);
+    has_P = (b > m);
+    if (has_P) {  // the part of the new Ritz vectors out of the span of the old ones, and its product with H
+      int bm = b - m;
+      F77_CALL(dgemm)("N", "N", &N, &m, &bm, &done, Q + (R_xlen_t)m * N, &N, Y + m, &b, &dzero, t->P, &N FCONE FCONE);
+      F77_CALL(dgemm)("N", "N", &N, &m, &bm, &done, HQ + (R_xlen_t)m * N, &N, Y + m, &b, &dzero, HP, &N FCONE FCONE);
+    }
+    memcpy(Q, T1, sizeof(double) * (size_t)N * m);
+    memcpy(HQ, T2, sizeof(double) * (size_t)N * m);
+
+    // residuals H*x - theta*x of the Ritz pairs (the converged ones are locked)
+    double *R = T1;
+    int nR = 0;
+    converged = 1;
+    nwanted = 0;
+    for (int c = 0; c < m; c++) {
+      double *r = R + (R_xlen_t)nR * N, nrm = 0.0;
+      for (int i = 0; i < N; i++) {
+        r[i] = HQ[(R_xlen_t)c * N + i] - theta[c] * Q[(R_xlen_t)c * N + i];
+        nrm += r[i] * r[i];
+      }
+      int conv_c = sqrt(nrm) <= tol;
+      if (s * theta[c] > 0) {  // the guards need not converge: the count of the wanted ones is certified
+        nwanted++;
+        converged &= conv_c;
+        nR += !conv_c;
+      }
+    }
+    if (converged || nwanted == m) break;
+
+    // new basis [X, P, R, H^-1 R], with the products of P with H known
+    int nP = has_P ? m : 0;
+    b = m;
+    if (has_P) {
+      memcpy(Q + (R_xlen_t)b * N, t->P, sizeof(double) * (size_t)N * m);
+      memcpy(HQ + (R_xlen_t)b * N, HP, sizeof(double) * (size_t)N * m);
+      b += m;
+    }
+    memcpy(Q + (R_xlen_t)b * N, R, sizeof(double) * (size_t)N * nR);
+    memcpy(Q + (R_xlen_t)(b + nR) * N, R, sizeof(double) * (size_t)N * nR);
+    F77_CALL(dsytrs)("L", &N, &nR, F, &N, ipiv, Q + (R_xlen_t)(b + nR) * N, &N, &info FCONE);
+    b = orth_columns(N, Q, HQ, m, b + 2 * nR, nP, &nP, work);
+    int nnew = b - m - nP;
+    cols += nnew + nR;  // products with H and solves with its factor, of about the same cost
+    if (nnew == 0 || cols > 2 * N) return 0;
+    double *Qn = Q + (R_xlen_t)(m + nP) * N, *HQn = HQ + (R_xlen_t)(m + nP) * N;
+    F77_CALL(dsymm)("L", "L", &N, &nnew, &done, H, &N, Qn, &N, &dzero, HQn, &N FCONE FCONE);
+  }
+
+  // all the wanted pairs converged, with guards left, and no eigenvalue of sign s outside the subspace
+  if (!converged || nwanted == m || nwanted != nsign) return 0;
+
+  for (int c = 0; c < nwanted; c++) lam[c] = theta[c];
+  memcpy(V, Q, sizeof(double) * (size_t)N * nwanted);
+  memcpy(t->X, Q, sizeof(double) * (size_t)N * m);
+  t->has_P = has_P;
+  t->n_warm++;
+  return 1;
+}
+
+// the factor L (N x r) of the PSD Hp = L L' of numerical rank r, by the Cholesky factorization of Hp with
+// complete pivoting P' Hp P = C C': L = P C[, 1:r] (at least one column, as .apprxHessian()); returns r
+static int psd_chol(int N, const double *Hp, double *L) {
+  int rank, info;
+  double tol = -1.0;  // the default of LAPACK: N * eps * max(diag(Hp))
+  double *C = (double *) R_alloc((size_t)N * N, sizeof(double));
+  double *work = (double *) R_alloc(2 * (size_t)N, sizeof(double));
+  int *piv = (int *) R_alloc(N, sizeof(int));
+  memcpy(C, Hp, sizeof(double) * (size_t)N * N);
+  F77_CALL(dpstrf)("L", &N, C, &N, piv, &rank, &tol, work, &info FCONE);
+  if (info < 0) error("Cholesky factorization failed in the PSD approximation (info = %d).", info);
+  int r = rank > 0 ? rank : 1;
+  memset(L, 0, sizeof(double) * (size_t)N * r);
+  for (int c = 0; c < rank; c++)
+    for (int i = c; i < N; i++) L[(R_xlen_t)c * N + piv[i] - 1] = C[(R_xlen_t)c * N + i];
+  return rank;
+}
+
+int psd_project(psd_tracker *t, const double *H, int need_L, double *Hp, double *L) {
+  int N = t->N, s, k;
+  double *lam = (double *) R_alloc(N, sizeof(double));
+  double *V = (double *) R_alloc((size_t)N * N, sizeof(double));
+
+  if (t->side != 0) {
+    // a small subspace is tracked: the inertia tells whether it still fits (with guards left), and then
+    // it is refined, else only the wanted eigenpairs are computed
+    double *F = (double *) R_alloc((size_t)N * N, sizeof(double));
+    int *ipiv = (int *) R_alloc(N, sizeof(int));
+    int nonsingular = psd_ldl(N, H, F, ipiv);
+    int npos = ldl_inertia(N, F, ipiv, 1), nneg = ldl_inertia(N, F, ipiv, -1);
+    s = (npos <= nneg) ? 1 : -1;
+    k = (s > 0) ? npos : nneg;
+    if (!(nonsingular && s == t->side && k + PSD_GUARD / 2 <= t->m && psd_refine(t, H, F, ipiv, k, lam, V)))
+      k = psd_partial(t, H, s, k, lam, V);
+  } else
+    k = psd_full(t, H, &s, lam, V);
+
+  // Y = V diag(sqrt(|lam|)), H+ = Y Y' (positive side) or H + Y Y' (negative side)
+  for (int c = 0; c < k; c++) {
+    double sc = sqrt(fabs(lam[c]));
+    for (int i = 0; i < N; i++) V[(R_xlen_t)c * N + i] *= sc;
+  }
+  double alpha = 1.0, beta = (s > 0) ? 0.0 : 1.0;
+  if (s < 0 && Hp != H) memcpy(Hp, H, sizeof(double) * (size_t)N * N);
+  if (k > 0)
+    F77_CALL(dsyrk)("L", "N", &N, &k, &alpha, V, &N, &beta, Hp, &N FCONE FCONE);
+  else if (s > 0)
+    memset(Hp, 0, sizeof(double) * (size_t)N * N);
+  for (int j = 0; j < N; j++)
+    for (int i = j + 1; i < N; i++) Hp[(R_xlen_t)i * N + j] = Hp[(R_xlen_t)j * N + i];
+
+  if (!need_L) return 0;
+  if (s > 0) {  // at least one column, as .apprxHessian()
+    if (k > 0) memcpy(L, V, sizeof(double) * (size_t)N * k);
+    else memset(L, 0, sizeof(double) * N);
+    return k;
+  }
+  return psd_chol(N, Hp, L);
+}
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+static void psd_tracker_finalizer(SEXP ptr) {
+  psd_free((psd_tracker *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+SEXP  psd_tracker_init(SEXP NN){
+  /*
+   arguments
+   NN        : integer, dimension of the matrices
+
+   returns an external pointer to the tracker of the eigenspaces
+   */
+
+  SEXP ptr = PROTECT(R_MakeExternalPtr(psd_alloc(asInteger(NN)), R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, psd_tracker_finalizer, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+SEXP  psd_tracker_project(SEXP PTR, SEXP HH, SEXP DECOMP){
+  /*
+   arguments
+   PTR       : external pointer returned by psd_tracker_init()
+   HH        : numeric N x N symmetric matrix
+   DECOMP    : logical, whether to return the factor L as well
+
+   returns list(hsn, L, warm) with the PSD approximation (as .apprxHessian()), its factor, and whether
+   it came from the tracked subspace (instead of a partial eigendecomposition)
+   */
+
+  psd_tracker *t = (psd_tracker *) R_ExternalPtrAddr(PTR);
+  if (!t) error("the PSD tracker is not valid anymore.");
+  int N = t->N, need_L = asLogical(DECOMP);
+  if (nrows(HH) != N || ncols(HH) != N) error("the matrix should be %d x %d.", N, N);
+
+  const char *names[] = {"hsn", "L", "warm", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  double *Hp = REAL(SET_VECTOR_ELT(res, 0, allocMatrix(REALSXP, N, N)));
+  double *L = need_L ? (double *) R_alloc((size_t)N * N, sizeof(double)) : NULL;
+  int n_warm = t->n_warm;
+  int k = psd_project(t, REAL(HH), need_L, Hp, L);
+  if (need_L) {
+    int n = k > 0 ? k : 1;
+    memcpy(REAL(SET_VECTOR_ELT(res, 1, allocMatrix(REALSXP, N, n))), L, sizeof(double) * (size_t)N * n);
+  }
+  SET_VECTOR_ELT(res, 2, ScalarLogical(t->n_warm > n_warm));
+  UNPROTECT(1);
+  return res;
+}
+
+#endif
@@ -0,0 +1,343 @@
+// Stateful accumulator of the sample co-moments over a sliding (and/or exponentially weighted)
+// window of returns.
+//
+// The accumulator keeps the weighted power sums of the (shifted) returns
+//   V1 = sum_t w_t,  V2 = sum_t w_t^2,  S1 = sum_t w_t x_t,  S2 = sum_t w_t x_t x_t',
+//   S3, S4 = the packed unique elements of sum_t w_t x_t (x) x_t (x) x_t [(x) x_t],
+// so that adding or removing a row is a rank-1 update of the sums in O(N^4/24), and the centered
+// moments are obtained on demand from the raw ones. The rows are shifted by a reference point
+// (the mean of the first rows, refreshed on every rebuild) to limit the cancellation in the
+// raw-to-central conversion.
+//
+// Exponential decay is implemented with growing weights: a row added after k others gets weight
+// decay^(-k), so older rows are relatively down-weighted without rescaling the sums at every step
+// (the weights are renormalized only when they get large). The rows in the window are stored to
+// be removed when they leave it and to rebuild the sums from scratch every "refresh" updates,
+// which bounds the round-off accumulated by the add/remove updates.
+
+#include "highOrderPortfolios.h"
+#include <math.h>
+
+typedef struct {
+  int N;
+  int window;       // number of rows in the window (0 means unbounded, rows are not stored)
+  int refresh;      // rebuild the sums every refresh updates (0 means never)
+  double decay;
+  int nrows;        // rows currently in the window
+  int head;         // position of the oldest row in the ring buffer
+  int since_rebuild;
+  double cur_w;     // weight of the next row
+  double V1, V2;
+  double *shift;    // N
+  double *S1;       // N
+  double *S2;       // N x N (upper triangle)
+  double *S3;       // N(N+1)(N+2)/6
+  double *S4;       // N(N+1)(N+2)(N+3)/24
+  double *rows;     // window x N (row-major ring buffer, unshifted)
+  double *row_w;    // window
+} comoments_acc;
+
+static void acc_free(comoments_acc *a) {
+  if (!a) return;
+  R_Free(a->shift); R_Free(a->S1); R_Free(a->S2); R_Free(a->S3); R_Free(a->S4);
+  if (a->rows) R_Free(a->rows);
+  if (a->row_w) R_Free(a->row_w);
+  R_Free(a);
+}
+
+static void acc_zero(comoments_acc *a) {
+  int N = a->N;
+  a->V1 = a->V2 = 0.0;
+  memset(a->S1, 0, sizeof(double) * (size_t)N);
+  memset(a->S2, 0, sizeof(double) * (size_t)N * N);
+  memset(a->S3, 0, sizeof(double) * (size_t)n_unique3(N));
+  memset(a->S4, 0, sizeof(double) * (size_t)n_unique4(N));
+}
+
+// add sum_t wt[t] * (powers of the T rows of the shifted block Xc), Xc being T x P column-major
+static void acc_accumulate(comoments_acc *a, const double *Xc, const double *wt, int T, int nthreads) {
+  int P = a->N;
+  double *S1 = a->S1, *S2 = a->S2, *S3 = a->S3, *S4 = a->S4;
+  for (int t = 0; t < T; t++) {
+    a->V1 += wt[t];
+    a->V2 += (wt[t] < 0 ? -1.0 : 1.0) * wt[t] * wt[t];  // a removed row takes its squared weight back
+  }
+
+  // each leading index ii owns a disjoint slice of the packed sums; y and z are per-thread scratch
+  double *yz = (double *) R_alloc(2 * (size_t)T * nthreads, sizeof(double));
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+    double *y = yz + 2 * (R_xlen_t)T * omp_get_thread_num();
+    double *z = y + T;
+    const double *xi = Xc + (R_xlen_t)ii * T;
+    double s1 = 0.0;
+    for (int t = 0; t < T; t++) s1 += wt[t] * xi[t];
+    S1[ii] += s1;
+    R_xlen_t iter3 = M3_index(P, ii, ii, ii);
+    R_xlen_t iter4 = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      const double *xj = Xc + (R_xlen_t)jj * T;
+      double s2 = 0.0;
+      for (int t = 0; t < T; t++) {
+        y[t] = wt[t] * xi[t] * xj[t];
+        s2 += y[t];
+      }
+      S2[(R_xlen_t)jj * P + ii] += s2;
+      for (int kk = jj; kk < P; kk++) {
+        const double *xk = Xc + (R_xlen_t)kk * T;
+        double s3 = 0.0;
+        for (int t = 0; t < T; t++) {
+          z[t] = y[t] * xk[t];
+          s3 += z[t];
+        }
+        S3[iter3++] += s3;
+        for (int ll = kk; ll < P; ll++) {
+          const double *xl = Xc + (R_xlen_t)ll * T;
+          double s4 = 0.0;
+          for (int t = 0; t < T; t++) s4 += z[t] * xl[t];
+          S4[iter4++] += s4;
+        } // loop ll
+      } // loop kk
+    } // loop jj
+  } // loop ii
+}
+
+// multiply all the weights by f (the moments do not change)
+static void acc_rescale(comoments_acc *a, double f) {
+  int N = a->N;
+  a->V1 *= f;
+  a->V2 *= f * f;
+  a->cur_w *= f;
+  for (int i = 0; i < N; i++) a->S1[i] *= f;
+  for (R_xlen_t k = 0; k < (R_xlen_t)N * N; k++) a->S2[k] *= f;
+  for (R_xlen_t k = 0; k < n_unique3(N); k++) a->S3[k] *= f;
+  for (R_xlen_t k = 0; k < n_unique4(N); k++) a->S4[k] *= f;
+  if (a->window > 0)
+    for (int r = 0; r < a->nrows; r++) a->row_w[(a->head + r) % a->window] *= f;
+}
+
+// recompute the sums from the rows in the window, re-centering the shift on their mean
+static void acc_rebuild(comoments_acc *a, int nthreads) {
+  int N = a->N, T = a->nrows;
+  acc_zero(a);
+  a->since_rebuild = 0;
+  if (T == 0) return;
+  double *Xc = (double *) R_alloc((size_t)T * N, sizeof(double));
+  double *wt = (double *) R_alloc(T, sizeof(double));
+  double f = 1.0 / a->row_w[(a->head + T - 1) % a->window];  // newest row gets weight 1
+  for (int r = 0; r < T; r++) wt[r] = a->row_w[(a->head + r) % a->window] *= f;
+  a->cur_w *= f;
+  for (int i = 0; i < N; i++) {
+    double s = 0.0;
+    for (int r = 0; r < T; r++) s += a->rows[(R_xlen_t)((a->head + r) % a->window) * N + i];
+    a->shift[i] = s / T;
+    for (int r = 0; r < T; r++)
+      Xc[(R_xlen_t)i * T + r] = a->rows[(R_xlen_t)((a->head + r) % a->window) * N + i] - a->shift[i];
+  }
+  acc_accumulate(a, Xc, wt, T, nthreads);
+}
+
+// add the T rows of X (T x N column-major), evicting the oldest rows beyond the window
+static void acc_update(comoments_acc *a, const double *X, int T, int nthreads) {
+  int N = a->N;
+  if (T <= 0) return;
+
+  // the first rows ever define the shift
+  if (a->nrows == 0 && a->V1 == 0.0)
+    for (int i = 0; i < N; i++) {
+      double s = 0.0;
+      for (int t = 0; t < T; t++) s += X[(R_xlen_t)i * T + t];
+      a->shift[i] = s / T;
+    }
+
+  // keep the weights in range
+  double growth = (a->decay < 1.0) ? pow(a->decay, -(double)T) : 1.0;
+  if (a->cur_w * growth > 1e100) acc_rescale(a, 1.0 / a->cur_w);
+
+  // a block longer than the window replaces it entirely
+  if (a->window > 0 && T >= a->window) {
+    int t0 = T - a->window;
+    for (int t = 0; t < a->window; t++) {
+      for (int i = 0; i < N; i++) a->rows[(R_xlen_t)t * N + i] = X[(R_xlen_t)i * T + t0 + t];
+      a->row_w[t] = a->cur_w;
+      a->cur_w /= a->decay;
+    }
+    a->head = 0;
+    a->nrows = a->window;
+    acc_rebuild(a, nthreads);
+    return;
+  }
+
+  // one sweep over the new rows (positive weights) and the evicted ones (negative weights)
+  int nevict = (a->window > 0 && a->nrows + T > a->window) ? a->nrows + T - a->window : 0;
+  int nb = T + nevict;
+  double *Xc = (double *) R_alloc((size_t)nb * N, sizeof(double));
+  double *wt = (double *) R_alloc(nb, sizeof(double));
+  for (int e = 0; e < nevict; e++) {
+    int pos = (a->head + e) % a->window;
+    wt[T + e] = - a->row_w[pos];
+    for (int i = 0; i < N; i++) Xc[(R_xlen_t)i * nb + T + e] = a->rows[(R_xlen_t)pos * N + i] - a->shift[i];
+  }
+  a->head = a->window > 0 ? (a->head + nevict) % a->window : 0;
+  a->nrows -= nevict;
+  for (int t = 0; t < T; t++) {
+    wt[t] = a->cur_w;
+    a->cur_w /= a->decay;
+    for (int i = 0; i < N; i++) Xc[(R_xlen_t)i * nb + t] = X[(R_xlen_t)i * T + t] - a->shift[i];
+    if (a->window > 0) {
+      int pos = (a->head + a->nrows) % a->window;
+      for (int i = 0; i < N; i++) a->rows[(R_xlen_t)pos * N + i] = X[(R_xlen_t)i * T + t];
+      a->row_w[pos] = wt[t];
+      a->nrows++;
+    } else
+      a->nrows++;
+  }
+  acc_accumulate(a, Xc, wt, nb, nthreads);
+
+  if (a->window > 0 && a->refresh > 0 && (a->since_rebuild += T) >= a->refresh)
+    acc_rebuild(a, nthreads);
+}
+
+// centered moments from the raw sums (Sgm normalized as stats::cov, Phi and Psi as M3.MM/M4.MM,
+// with the usual reliability-weights correction for the covariance when the rows are weighted)
+static void acc_extract(const comoments_acc *a, int nthreads, double *mu, double *Sgm, double *Phi, double *Psi) {
+  int P = a->N;
+  double V1 = a->V1;
+  double *m = (double *) R_alloc(P, sizeof(double));
+  double *E2 = (double *) R_alloc((size_t)P * P, sizeof(double));
+  for (int i = 0; i < P; i++) {
+    m[i] = a->S1[i] / V1;
+    mu[i] = m[i] + a->shift[i];
+  }
+  for (int j = 0; j < P; j++)
+    for (int i = 0; i <= j; i++) {
+      double e = a->S2[(R_xlen_t)j * P + i] / V1;
+      E2[(R_xlen_t)j * P + i] = e;
+      E2[(R_xlen_t)i * P + j] = e;
+    }
+  double cov_scale = V1 * V1 / (V1 * V1 - a->V2);
+  for (int j = 0; j < P; j++)
+    for (int i = 0; i < P; i++)
+      Sgm[(R_xlen_t)j * P + i] = (E2[(R_xlen_t)j * P + i] - m[i] * m[j]) * cov_scale;
+
+#define E2_(i, j) E2[(R_xlen_t)(j) * P + (i)]
+#define E3_(i, j, k) (a->S3[M3_index(P, i, j, k)] / V1)
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads))
+  for (int ii = 0; ii < P; ii++) {
+    R_xlen_t iter3 = M3_index(P, ii, ii, ii);
+    R_xlen_t iter4 = M4_index(P, ii, ii, ii, ii);
+    for (int jj = ii; jj < P; jj++) {
+      for (int kk = jj; kk < P; kk++) {
+        double mij = m[ii] * m[jj];
+        Phi[iter3] = a->S3[iter3] / V1 - m[ii] * E2_(jj, kk) - m[jj] * E2_(ii, kk) - m[kk] * E2_(ii, jj)
+                     + 2 * mij * m[kk];
+        iter3++;
+        for (int ll = kk; ll < P; ll++) {
+          Psi[iter4] = a->S4[iter4] / V1
+            - m[ii] * E3_(jj, kk, ll) - m[jj] * E3_(ii, kk, ll) - m[kk] * E3_(ii, jj, ll) - m[ll] * E3_(ii, jj, kk)
+            + mij * E2_(kk, ll) + m[ii] * m[kk] * E2_(jj, ll) + m[ii] * m[ll] * E2_(jj, kk)
+            + m[jj] * m[kk] * E2_(ii, ll) + m[jj] * m[ll] * E2_(ii, kk) + m[kk] * m[ll] * E2_(ii, jj)
+            - 3 * mij * m[kk] * m[ll];
+          iter4++;
+        } // loop ll
+      } // loop kk
+    } // loop jj
+  } // loop ii
+#undef E2_
+#undef E3_
+}
+
+
+static void comoments_acc_finalizer(SEXP ptr) {
+  acc_free((comoments_acc *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+static comoments_acc *get_acc(SEXP PTR) {
+  comoments_acc *a = (comoments_acc *) R_ExternalPtrAddr(PTR);
+  if (!a) error("invalid sample moments accumulator.");
+  return a;
+}
+
+SEXP  comoments_acc_init(SEXP PP, SEXP WINDOW, SEXP DECAY, SEXP REFRESH){
+  /*
+   arguments
+   PP        : integer, number of assets
+   WINDOW    : integer, number of rows in the window (0 for an expanding window)
+   DECAY     : numeric in (0, 1], exponential decay of the weights of older rows
+   REFRESH   : integer, number of updates between rebuilds of the sums (0 for never)
+
+   returns an external pointer to an empty accumulator
+   */
+
+  int N = asInteger(PP), window = asInteger(WINDOW), refresh = asInteger(REFRESH);
+  double decay = asReal(DECAY);
+  if (N < 1) error("the number of assets must be positive.");
+  if (window < 0) error("the window length cannot be negative.");
+  if (!(decay > 0 && decay <= 1)) error("the decay must be in (0, 1].");
+
+  comoments_acc *a = R_Calloc(1, comoments_acc);
+  a->N = N;
+  a->window = window;
+  a->refresh = window > 0 ? refresh : 0;
+  a->decay = decay;
+  a->cur_w = 1.0;
+  a->shift = R_Calloc(N, double);
+  a->S1 = R_Calloc(N, double);
+  a->S2 = R_Calloc((size_t)N * N, double);
+  a->S3 = R_Calloc(n_unique3(N), double);
+  a->S4 = R_Calloc(n_unique4(N), double);
+  if (window > 0) {
+    a->rows = R_Calloc((size_t)window * N, double);
+    a->row_w = R_Calloc(window, double);
+  }
+  SEXP ptr = PROTECT(R_MakeExternalPtr(a, install("comoments_acc"), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, comoments_acc_finalizer, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+SEXP  comoments_acc_update(SEXP PTR, SEXP XX, SEXP NTHREADS){
+  /*
+   arguments
+   PTR       : external pointer returned by comoments_acc_init
+   XX        : numeric T x N matrix with the new returns (in chronological order)
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   adds the rows to the accumulator (removing those leaving the window) and returns the number of
+   rows in the window
+   */
+
+  comoments_acc *a = get_acc(PTR);
+  if (ncols(XX) != a->N) error("the returns must have one column per asset.");
+  acc_update(a, REAL(XX), nrows(XX), hop_num_threads(asInteger(NTHREADS)));
+  return ScalarInteger(a->nrows);
+}
+
+SEXP  comoments_acc_extract(SEXP PTR, SEXP NTHREADS){
+  /*
+   arguments
+   PTR       : external pointer returned by comoments_acc_init
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns a list with the mean vector, covariance matrix, and the unique elements of the
+   coskewness and cokurtosis matrices of the rows in the window
+   */
+
+  comoments_acc *a = get_acc(PTR);
+  int P = a->N;
+  if (a->nrows < 2) error("at least two observations are needed.");
+
+  const char *names[] = {"mu", "Sgm", "Phi", "Psi", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(res, 0, allocVector(REALSXP, P));
+  SET_VECTOR_ELT(res, 1, allocMatrix(REALSXP, P, P));
+  SET_VECTOR_ELT(res, 2, allocVector(REALSXP, n_unique3(P)));
+  SET_VECTOR_ELT(res, 3, allocVector(REALSXP, n_unique4(P)));
+
+  acc_extract(a, hop_num_threads(asInteger(NTHREADS)), REAL(VECTOR_ELT(res, 0)), REAL(VECTOR_ELT(res, 1)),
+              REAL(VECTOR_ELT(res, 2)), REAL(VECTOR_ELT(res, 3)));
+
+  UNPROTECT(1);
+  return res;
+}
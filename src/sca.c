@@ -0,0 +1,256 @@
+// Native successive convex approximation (SCA) loop for the MVSK portfolio with sample moments:
+//
+//   minimize     - lmd1*(w'*mu) + lmd2*(w'*Sigma*w) - lmd3*(w'*Phi*w*w) + lmd4*(w'*Psi*w*w*w)
+//   subject to   w >= 0, sum(w) == 1,
+//
+// for the methods "Q-MVSK", "MM", and "DC" (same iterates as the R implementation in
+// design_MVSK_portfolio_via_sample_moments()). The QP subproblems are solved by the simplex QP
+// of simplex_qp.c: for "MM" its Hessian is constant, so the factor (and the active set) carry over
+// from one iteration to the next, and for "DC" it is diagonal and solved in closed form. The PSD
+// approximation of the Hessian of "Q-MVSK" tracks its eigenspace across the iterations (psd.c).
+
+#include "highOrderPortfolios.h"
+#include <math.h>
+
+typedef struct {
+  int N, method, nthreads;
+  const double *lmd, *mu, *Sgm;
+  hop_comoment Phi, Psi;  // in any storage
+  double *jac;      // 4 x N, as the jacobian in the R implementation
+  double *H34;      // N x N, - lmd3*H3 + lmd4*H4 (only for "Q-MVSK")
+  double obj;
+} sca_eval;
+
+// moments' gradients and objective at w (and the Hessian of the non-convex part for "Q-MVSK")
+static void sca_fun_eval(sca_eval *e, const double *w) {
+  int N = e->N;
+  double *g2 = e->jac + (R_xlen_t)N, *g3 = e->jac + 2 * (R_xlen_t)N, *g4 = e->jac + 3 * (R_xlen_t)N;
+  const void *vmax = vmaxget();
+
+  for (int i = 0; i < N; i++) {
+    double s = 0.0;
+    for (int j = 0; j < N; j++) s += e->Sgm[(R_xlen_t)j * N + i] * w[j];
+    e->jac[i] = e->mu[i];
+    g2[i] = 2 * s;
+  }
+  if (e->method == SCA_QMVSK) {
+    double *B = (double *) R_alloc((size_t)N * N, sizeof(double));
+    hop_port_hess_kernel(&e->Phi, w, N, e->nthreads, e->H34);
+    hop_port_hess_kernel(&e->Psi, w, N, e->nthreads, B);
+    for (int i = 0; i < N; i++) {
+      double s3 = 0.0, s4 = 0.0;
+      for (int j = 0; j < N; j++) {
+        s3 += e->H34[(R_xlen_t)j * N + i] * w[j];
+        s4 += B[(R_xlen_t)j * N + i] * w[j];
+      }
+      g3[i] = 3 * s3;
+      g4[i] = 4 * s4;
+    }
+    for (R_xlen_t k = 0; k < (R_xlen_t)N * N; k++) e->H34[k] = - e->lmd[2] * 6 * e->H34[k] + e->lmd[3] * 12 * B[k];
+  } else {
+    hop_port_kernel(&e->Phi, w, N, e->nthreads, g3);
+    hop_port_kernel(&e->Psi, w, N, e->nthreads, g4);
+  }
+
+  static const double cf[4] = {-1.0, 2.0, -3.0, 4.0};
+  e->obj = 0.0;
+  for (int r = 0; r < 4; r++) {
+    double s = 0.0;
+    for (int i = 0; i < N; i++) s += e->jac[(R_xlen_t)r * N + i] * w[i];
+    e->obj += e->lmd[r] * s / cf[r];
+  }
+  vmaxset(vmax);
+}
+
+void sca_run(const double *lmd, const double *mu, const double *Sgm, const hop_comoment *Phi, const hop_comoment *Psi,
+             int N, const sca_options *opt, simplex_qp *qp, psd_tracker *psd, double *w, sca_trace *tr) {
+  int method = opt->method, maxiter = opt->maxiter, profile = tr->prof != NULL;
+  double tau_w = opt->tau_w, gamma = opt->gamma, zeta = opt->zeta, rho = opt->rho;
+  double start_time = hop_time(), t0 = 0.0;
+  double *cpu_time = tr->cpu_time, *objs = tr->objs, *prof = tr->prof;
+
+  sca_eval e = {.N = N, .method = method, .nthreads = opt->nthreads, .lmd = lmd, .mu = mu, .Sgm = Sgm,
+                .Phi = *Phi, .Psi = *Psi, .jac = tr->jac,
+                .H34 = method == SCA_QMVSK ? (double *) R_alloc((size_t)N * N, sizeof(double)) : NULL};
+
+  sqp_set_leverage(qp, opt->leverage);
+  double *Qk = (double *) R_alloc((size_t)N * N, sizeof(double));
+  double *qk = (double *) R_alloc(N, sizeof(double));
+  double *w_hat = (double *) R_alloc(N, sizeof(double));
+  double *w_old = (double *) R_alloc(N, sizeof(double));
+  double *Hw = (double *) R_alloc(N, sizeof(double));
+  if (method == SCA_MM) {
+    for (R_xlen_t k = 0; k < (R_xlen_t)N * N; k++) Qk[k] = 2 * lmd[1] * Sgm[k];
+    for (int i = 0; i < N; i++) Qk[(R_xlen_t)i * N + i] += rho;
+    sqp_set_Q(qp, Qk, 0);
+  } else if (method == SCA_DC) {
+    for (int i = 0; i < N; i++) Qk[i] = rho;
+    sqp_set_Q(qp, Qk, 1);
+  }
+
+  // per iteration: time of the function evaluation, the PSD approximation, and the QP, and QP iterations
+  if (profile) {
+    memset(prof, 0, sizeof(double) * 4 * ((size_t)maxiter + 1));
+    t0 = hop_time();
+  }
+  cpu_time[0] = 0.0;
+  sca_fun_eval(&e, w);
+  objs[0] = e.obj;
+  if (profile) prof[0] = hop_time() - t0;
+
+  const double *g1 = e.jac, *g2 = e.jac + N, *g3 = e.jac + 2 * N, *g4 = e.jac + 3 * N;
+  int iter, has_timed_out = 0;
+  for (iter = 1; iter <= maxiter; iter++) {
+    R_CheckUserInterrupt();
+    memcpy(w_old, w, sizeof(double) * N);
+
+    // construct the QP approximation problem (in the format of quadprog::solve.QP)
+    switch (method) {
+    case SCA_QMVSK: {
+      const void *vmax = vmaxget();
+      if (profile) t0 = hop_time();
+      psd_project(psd, e.H34, 0, e.H34, NULL);
+      if (profile) prof[4 * iter + 1] = hop_time() - t0;
+      vmaxset(vmax);
+      for (int i = 0; i < N; i++) {
+        double s = 0.0;
+        for (int j = 0; j < N; j++) s += e.H34[(R_xlen_t)j * N + i] * w[j];
+        Hw[i] = s;
+      }
+      for (R_xlen_t k = 0; k < (R_xlen_t)N * N; k++) Qk[k] = 2 * lmd[1] * Sgm[k] + e.H34[k];
+      for (int i = 0; i < N; i++) {
+        Qk[(R_xlen_t)i * N + i] += tau_w;
+        qk[i] = lmd[0] * mu[i] + lmd[2] * g3[i] - lmd[3] * g4[i] + Hw[i] + tau_w * w[i];
+      }
+      sqp_set_Q(qp, Qk, 0);
+      break;
+    }
+    case SCA_MM:
+      for (int i = 0; i < N; i++) qk[i] = lmd[0] * mu[i] + lmd[2] * g3[i] - lmd[3] * g4[i] + rho * w[i];
+      break;
+    case SCA_DC:
+      for (int i = 0; i < N; i++)
+        qk[i] = rho * w[i] + lmd[0] * g1[i] - lmd[1] * g2[i] + lmd[2] * g3[i] - lmd[3] * g4[i];
+      break;
+    default:
+      error("Method unknown");
+    }
+
+    // solve the QP problem and update w
+    if (profile) t0 = hop_time();
+    int qp_iter = sqp_solve(qp, qk, w_hat);
+    if (profile) {
+      prof[4 * iter + 2] = hop_time() - t0;
+      prof[4 * iter + 3] = qp_iter;
+    }
+    for (int i = 0; i < N; i++) w[i] += gamma * (w_hat[i] - w[i]);
+    gamma = gamma * (1 - zeta * gamma);
+
+    // recording...
+    cpu_time[iter] = hop_time() - start_time;
+    if (profile) t0 = hop_time();
+    sca_fun_eval(&e, w);
+    if (profile) prof[4 * iter] = hop_time() - t0;
+    objs[iter] = e.obj;
+
+    // termination criterion
+    int has_w_converged = 1;
+    for (int i = 0; i < N; i++)
+      if (fabs(w[i] - w_old[i]) > .5 * opt->wtol * (fabs(w[i]) + fabs(w_old[i]))) {
+        has_w_converged = 0;
+        break;
+      }
+    int has_f_converged = fabs(objs[iter] - objs[iter - 1]) <= .5 * opt->ftol * (fabs(objs[iter]) + fabs(objs[iter - 1]));
+    int has_cross_stopval = objs[iter] <= opt->stopval;
+    if (has_w_converged || has_f_converged || has_cross_stopval) break;
+    has_timed_out = hop_time() - start_time >= opt->maxtime;
+    if (has_timed_out) break;
+  }
+  tr->iterations = iter > maxiter ? maxiter : iter;
+  tr->timed_out = has_timed_out;
+}
+
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+static void sca_qp_finalizer(SEXP ptr) {
+  sqp_free((simplex_qp *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+static void sca_psd_finalizer(SEXP ptr) {
+  psd_free((psd_tracker *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+SEXP  MVSK_sca(SEXP LMD, SEXP MU, SEXP SGM, SEXP PHI, SEXP PSI, SEXP WINIT, SEXP METHOD, SEXP PARAMS,
+               SEXP MAXITER, SEXP NTHREADS, SEXP PROFILE){
+  /*
+   arguments
+   LMD       : numeric vector of length 4, weights of the moments
+   MU, SGM   : numeric vector and N x N matrix, mean and covariance
+   PHI, PSI  : unique elements of the coskewness and cokurtosis matrices (in any storage, see hop_comoment)
+   WINIT     : numeric vector, initial portfolio
+   METHOD    : integer, 0 = "Q-MVSK", 1 = "MM", 2 = "DC"
+   PARAMS    : numeric vector (tau_w, gamma, zeta, rho, ftol, wtol, stopval, leverage, maxtime),
+               maxtime being the budget of elapsed seconds (checked after each iteration)
+   MAXITER   : integer, maximum number of iterations
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+   PROFILE   : logical, whether to time the phases of each iteration
+
+   returns a list with the solution, the elapsed time and objective per iteration, the number of
+   iterations, whether the budget of time ran out, the moments' gradients at the solution, and (if
+   PROFILE) the (iterations + 1) x 4 matrix with the time of the function evaluation, PSD approximation,
+   and QP solve, and the iterations of the QP solver at each iteration (the first row being the
+   initialization)
+   */
+
+  int N = LENGTH(MU), maxiter = asInteger(MAXITER);
+  const double *par = REAL(PARAMS);
+  sca_options opt = {asInteger(METHOD), maxiter, hop_num_threads(asInteger(NTHREADS)),
+                     par[0], par[1], par[2], par[3], par[4], par[5], par[6], par[7], par[8]};
+  hop_comoment Phi = hop_comoment_get(PHI, 3, N), Psi = hop_comoment_get(PSI, 4, N);
+
+  // the QP workspace lives in an external pointer so that it is released also on error
+  simplex_qp *qp = sqp_alloc(N);
+  SEXP qp_ptr = PROTECT(R_MakeExternalPtr(qp, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(qp_ptr, sca_qp_finalizer, TRUE);
+  // and so does the eigenspace tracked for the PSD approximation of "Q-MVSK"
+  psd_tracker *psd = opt.method == SCA_QMVSK ? psd_alloc(N) : NULL;
+  SEXP psd_ptr = PROTECT(R_MakeExternalPtr(psd, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(psd_ptr, sca_psd_finalizer, TRUE);
+
+  SEXP W = PROTECT(duplicate(WINIT));
+  sca_trace tr;
+  tr.cpu_time = (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.objs = (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.prof = asLogical(PROFILE) == TRUE ? (double *) R_alloc(4 * ((size_t)maxiter + 1), sizeof(double)) : NULL;
+  tr.jac = (double *) R_alloc(4 * (size_t)N, sizeof(double));
+  sca_run(REAL(LMD), REAL(MU), REAL(SGM), &Phi, &Psi, N, &opt, qp, psd, REAL(W), &tr);
+  int iter = tr.iterations;
+
+  const char *names[] = {"w", "cpu_time_vs_iterations", "objfun_vs_iterations", "iterations", "timed_out", "jac",
+                         "profile", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(res, 0, W);
+  SEXP tm = SET_VECTOR_ELT(res, 1, allocVector(REALSXP, iter + 1));
+  SEXP ob = SET_VECTOR_ELT(res, 2, allocVector(REALSXP, iter + 1));
+  memcpy(REAL(tm), tr.cpu_time, sizeof(double) * (iter + 1));
+  memcpy(REAL(ob), tr.objs, sizeof(double) * (iter + 1));
+  SET_VECTOR_ELT(res, 3, ScalarInteger(iter));
+  SET_VECTOR_ELT(res, 4, ScalarLogical(tr.timed_out));
+  SEXP jac = SET_VECTOR_ELT(res, 5, allocMatrix(REALSXP, 4, N));
+  for (int r = 0; r < 4; r++)
+    for (int i = 0; i < N; i++) REAL(jac)[(R_xlen_t)i * 4 + r] = tr.jac[(R_xlen_t)r * N + i];
+  if (tr.prof) {
+    SEXP pr = SET_VECTOR_ELT(res, 6, allocMatrix(REALSXP, iter + 1, 4));
+    for (int k = 0; k <= iter; k++)
+      for (int c = 0; c < 4; c++) REAL(pr)[(R_xlen_t)c * (iter + 1) + k] = tr.prof[4 * k + c];
+  }
+
+  UNPROTECT(4);
+  return res;
+}
+
+#endif
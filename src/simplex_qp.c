@@ -0,0 +1,414 @@
+// Quadratic programs over the simplex {w >= 0, sum(w) == 1}:
+//
+//   minimize  0.5*w'Qw - q'w
+//
+// (the sign convention of quadprog::solve.QP). The constraint set never changes along the SCA
+// iterations, so instead of a general solver we use:
+//   - for diagonal Q, the closed-form solution w_i = max(0, (q_i + nu)/Q_ii) with nu found after
+//     sorting the breakpoints (O(N log N)),
+//   - otherwise, a primal active-set method warm-started from the previous solution. Only the
+//     free variables (w_i > 0) enter the equality-constrained subproblems, whose Cholesky factor is
+//     kept across calls and updated when a variable enters or leaves the free set. Since the optimal
+//     portfolios are typically sparse, each solve costs a few O(k^2) updates for k active assets.
+//
+// With leverage L > 1 the set is {sum(|w|) <= L, sum(w) == 1}, i.e., in the signed split w = w+ - w-
+// (w+, w- >= 0), sum(w+) - sum(w-) == 1 and sum(w+) + sum(w-) <= L. A free variable is then one of
+// w+_i or w-_i (never both, which is never better), so the same factor of Q over the free assets
+// serves, with the sign of each free asset kept aside, and the working set has at most one more
+// row, s'w == L with s the signs. For diagonal Q the split decouples into a long and a short simplex
+// (of totals (L + 1)/2 and (L - 1)/2) whenever the leverage constraint is active.
+
+#include "highOrderPortfolios.h"
+#include <math.h>
+
+simplex_qp *sqp_alloc(int N) {
+  simplex_qp *s = R_Calloc(1, simplex_qp);
+  s->N = N;
+  s->Q = R_Calloc((size_t)N * N, double);
+  s->free = R_Calloc(N, int);
+  s->is_free = R_Calloc(N, int);
+  s->sign = R_Calloc(N, int);
+  s->leverage = 1.0;
+  s->R = R_Calloc((size_t)N * N, double);
+  s->w = R_Calloc(N, double);
+  s->work = R_Calloc(4 * (size_t)N, double);
+  s->iwork = R_Calloc(N, int);
+  return s;
+}
+
+void sqp_free(simplex_qp *s) {
+  if (!s) return;
+  R_Free(s->Q); R_Free(s->free); R_Free(s->is_free); R_Free(s->sign); R_Free(s->R);
+  R_Free(s->w); R_Free(s->work); R_Free(s->iwork);
+  R_Free(s);
+}
+
+// new Hessian (the warm start is kept, the factor is not)
+void sqp_set_Q(simplex_qp *s, const double *Q, int diag) {
+  s->diag = diag;
+  memcpy(s->Q, Q, sizeof(double) * (diag ? (size_t)s->N : (size_t)s->N * s->N));
+  s->factored = 0;
+}
+
+// new bound on sum(|w|) (the warm start is dropped if it does not satisfy it)
+void sqp_set_leverage(simplex_qp *s, double leverage) {
+  if (leverage < s->leverage) s->has_w = 0;
+  s->leverage = leverage;
+  s->factored = 0;
+}
+
+// closed-form solution for Q = diag(d) (or d_scalar * I if d == NULL)
+void simplex_diag_qp(int N, const double *d, double d_scalar, const double *q, double *w, double *work, int *iwork) {
+  // variables become positive in decreasing order of q_i as nu increases
+  for (int i = 0; i < N; i++) {
+    work[i] = -q[i];
+    iwork[i] = i;
+  }
+  rsort_with_index(work, iwork, N);
+
+  double s0 = 0.0, s1 = 0.0, nu = 0.0;
+  for (int k = 0; k < N; k++) {
+    int i = iwork[k];
+    double di = d ? d[i] : d_scalar;
+    s0 += 1.0 / di;
+    s1 += q[i] / di;
+    double nu_k = (1.0 - s1) / s0;
+    if (k == 0 || q[i] + nu_k > 0) nu = nu_k;
+    else break;
+  }
+  for (int i = 0; i < N; i++) {
+    double v = (q[i] + nu) / (d ? d[i] : d_scalar);
+    w[i] = v > 0 ? v : 0.0;
+  }
+}
+
+// closed-form solution over {sum(|w|) <= leverage, sum(w) == 1} for Q = diag(d) (or d_scalar * I);
+// work is 3N
+void leverage_diag_qp(int N, const double *d, double d_scalar, double leverage, const double *q, double *w,
+                      double *work, int *iwork) {
+  // without the leverage constraint, w = (q + nu)/d with sum(w) == 1
+  double s0 = 0.0, s1 = 0.0, l1 = 0.0;
+  for (int i = 0; i < N; i++) {
+    double di = d ? d[i] : d_scalar;
+    s0 += 1.0 / di;
+    s1 += q[i] / di;
+  }
+  double nu = (1.0 - s1) / s0;
+  for (int i = 0; i < N; i++) {
+    w[i] = (q[i] + nu) / (d ? d[i] : d_scalar);
+    l1 += fabs(w[i]);
+  }
+  if (l1 <= leverage) return;
+
+  // else the long and the short parts are the solutions over the simplices of totals (L + 1)/2 and
+  // (L - 1)/2, i.e., c times those of the simplex with linear terms q/c and -q/c
+  double *qc = work + N, *wneg = work + 2 * N, cpos = (leverage + 1) / 2, cneg = (leverage - 1) / 2;
+  for (int i = 0; i < N; i++) qc[i] = q[i] / cpos;
+  simplex_diag_qp(N, d, d_scalar, qc, w, work, iwork);
+  for (int i = 0; i < N; i++) qc[i] = -q[i] / cneg;
+  simplex_diag_qp(N, d, d_scalar, qc, wneg, work, iwork);
+  for (int i = 0; i < N; i++) w[i] = cpos * w[i] - cneg * wneg[i];
+}
+
+#define QQ(i, j) s->Q[(R_xlen_t)(j) * s->N + (i)]
+#define RR(i, j) s->R[(R_xlen_t)(j) * s->N + (i)]
+
+// append variable j to the free set, extending the factor
+static void sqp_add(simplex_qp *s, int j) {
+  int n = s->nfree;
+  double d = QQ(j, j);
+  for (int i = 0; i < n; i++) {
+    double r = QQ(s->free[i], j);
+    for (int k = 0; k < i; k++) r -= RR(k, i) * RR(k, n);
+    r /= RR(i, i);
+    RR(i, n) = r;
+    d -= r * r;
+  }
+  if (d <= 1e-14 * QQ(j, j) || d <= 0)
+    error("matrix Q in the simplex-constrained QP is not positive definite.");
+  RR(n, n) = sqrt(d);
+  s->free[n] = j;
+  s->is_free[j] = 1;
+  s->nfree = n + 1;
+}
+
+// remove the variable at position p of the free set, restoring triangularity with Givens rotations
+static void sqp_del(simplex_qp *s, int p) {
+  int n = s->nfree;
+  s->is_free[s->free[p]] = 0;
+  for (int c = p; c < n - 1; c++) {
+    s->free[c] = s->free[c + 1];
+    for (int i = 0; i <= c + 1; i++) RR(i, c) = RR(i, c + 1);
+  }
+  for (int c = p; c < n - 1; c++) {
+    double a = RR(c, c), b = RR(c + 1, c), r = hypot(a, b);
+    double cs = a / r, sn = b / r;
+    for (int k = c; k < n - 1; k++) {
+      double x = RR(c, k), y = RR(c + 1, k);
+      RR(c, k) = cs * x + sn * y;
+      RR(c + 1, k) = -sn * x + cs * y;
+    }
+    RR(c + 1, c) = 0.0;
+  }
+  s->nfree = n - 1;
+}
+
+// solve R'R x = b in place (leading nfree block)
+static void sqp_chol_solve(const simplex_qp *s, double *x) {
+  int n = s->nfree;
+  for (int i = 0; i < n; i++) {
+    double v = x[i];
+    for (int k = 0; k < i; k++) v -= RR(k, i) * x[k];
+    x[i] = v / RR(i, i);
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double v = x[i];
+    for (int k = i + 1; k < n; k++) v -= RR(i, k) * x[k];
+    x[i] = v / RR(i, i);
+  }
+}
+
+int sqp_solve(simplex_qp *s, const double *q, double *wout) {
+  int N = s->N;
+  double *w = s->w;
+
+  if (s->diag) {
+    if (s->leverage > 1) leverage_diag_qp(N, s->Q, 0.0, s->leverage, q, w, s->work, s->iwork);
+    else simplex_diag_qp(N, s->Q, 0.0, q, w, s->work, s->iwork);
+    s->has_w = 1;
+    s->iterations = 0;
+    memcpy(wout, w, sizeof(double) * N);
+    return 0;
+  }
+
+  // starting point: previous solution, or else the best vertex
+  if (!s->has_w) {
+    int jbest = 0;
+    for (int j = 1; j < N; j++)
+      if (0.5 * QQ(j, j) - q[j] < 0.5 * QQ(jbest, jbest) - q[jbest]) jbest = j;
+    for (int j = 0; j < N; j++) w[j] = (j == jbest);
+  }
+
+  // make the free set match the support (and signs) of the starting point, updating (or rebuilding) the factor
+  double L = s->leverage, lw = 0.0;
+  int shorts = L > 1;
+  if (s->factored) {
+    for (int p = s->nfree - 1; p >= 0; p--)
+      if (s->sign[s->free[p]] * w[s->free[p]] <= 0) sqp_del(s, p);
+  } else {
+    for (int j = 0; j < N; j++) s->is_free[j] = 0;
+    s->nfree = 0;
+    s->factored = 1;
+  }
+  for (int j = 0; j < N; j++) {
+    if (w[j] > 0 || (shorts && w[j] < 0)) {
+      if (!s->is_free[j]) {
+        s->sign[j] = w[j] > 0 ? 1 : -1;
+        sqp_add(s, j);
+      }
+    } else
+      w[j] = 0.0;
+    lw += fabs(w[j]);
+  }
+  // the leverage constraint stays in the working set if the starting point is on it
+  s->l1 = shorts && s->l1 && lw >= L * (1 - 1e-12);
+
+  double scale = 1.0;
+  for (int j = 0; j < N; j++) {
+    if (fabs(q[j]) > scale) scale = fabs(q[j]);
+    if (fabs(QQ(j, j)) > scale) scale = fabs(QQ(j, j));
+  }
+  double tol = 1e-11 * scale;
+
+  double *a = s->work, *b = s->work + N, *x = s->work + 2 * N, *c = s->work + 3 * N;
+  int iter, maxiter = 10 * N + 100;
+  for (iter = 1; iter <= maxiter; iter++) {
+    // equality-constrained subproblem on the free set: x = a + nu*b (- lmd*c), with sum(x) == 1
+    // (and s'x == L, with multiplier lmd, when the leverage constraint is in the working set)
+    int n = s->nfree, nshort = 0;
+    for (int k = 0; k < n; k++) nshort += s->sign[s->free[k]] < 0;
+    if (nshort == 0) s->l1 = 0;  // s'x == sum(x) == 1 < L
+    for (int k = 0; k < n; k++) {
+      a[k] = q[s->free[k]];
+      b[k] = 1.0;
+    }
+    sqp_chol_solve(s, a);
+    sqp_chol_solve(s, b);
+    double sa = 0.0, sb = 0.0;
+    for (int k = 0; k < n; k++) {
+      sa += a[k];
+      sb += b[k];
+    }
+    double nu, lmd = 0.0;
+    if (s->l1) {
+      double ssa = 0.0, ssb = 0.0, sc = 0.0, ssc = 0.0;
+      for (int k = 0; k < n; k++) c[k] = s->sign[s->free[k]];
+      sqp_chol_solve(s, c);
+      for (int k = 0; k < n; k++) {
+        int sk = s->sign[s->free[k]];
+        ssa += sk * a[k];
+        ssb += sk * b[k];
+        sc += c[k];
+        ssc += sk * c[k];
+      }
+      // [sb -sc; ssb -ssc] (nu, lmd) = (1 - sa, L - ssa)
+      double det = -sb * ssc + sc * ssb;
+      nu = (-(1.0 - sa) * ssc + sc * (L - ssa)) / det;
+      lmd = (sb * (L - ssa) - ssb * (1.0 - sa)) / det;
+      for (int k = 0; k < n; k++) x[k] = a[k] + nu * b[k] - lmd * c[k];
+    } else {
+      nu = (1.0 - sa) / sb;
+      for (int k = 0; k < n; k++) x[k] = a[k] + nu * b[k];
+    }
+
+    // largest feasible step towards x: a free variable reaching zero, or the leverage constraint
+    double t = 1.0;
+    int pblock = -1;
+    for (int k = 0; k < n; k++) {
+      int sk = s->sign[s->free[k]];
+      if (sk * x[k] < -1e-14) {
+        double wk = w[s->free[k]];
+        double tk = wk / (wk - x[k]);
+        if (tk < t) {
+          t = tk;
+          pblock = k;
+        }
+      }
+    }
+    if (shorts && !s->l1) {
+      double lw0 = 0.0, lx = 0.0;
+      for (int k = 0; k < n; k++) {
+        int sk = s->sign[s->free[k]];
+        lw0 += sk * w[s->free[k]];
+        lx += sk * x[k];
+      }
+      if (lx > L * (1 + 1e-14)) {
+        double tl = lw0 < L ? (L - lw0) / (lx - lw0) : 0.0;
+        if (tl < t) {
+          t = tl;
+          pblock = n;
+        }
+      }
+    }
+
+    if (pblock >= 0) {
+      for (int k = 0; k < n; k++) w[s->free[k]] += t * (x[k] - w[s->free[k]]);
+      if (pblock == n)
+        s->l1 = 1;
+      else {
+        w[s->free[pblock]] = 0.0;
+        sqp_del(s, pblock);
+      }
+      continue;
+    }
+
+    // full step; a negative multiplier of the leverage constraint removes it from the working set
+    for (int k = 0; k < n; k++) w[s->free[k]] = s->sign[s->free[k]] * x[k] > 0 ? x[k] : 0.0;
+    if (s->l1 && lmd < -tol) {
+      s->l1 = 0;
+      continue;
+    }
+
+    // check the multipliers of the variables at zero: (Qw - q)_i - nu + lmd >= 0 for w+_i, and
+    // -(Qw - q)_i + nu + lmd >= 0 for w-_i (only with leverage)
+    int jmin = -1, smin = 1;
+    double mumin = -tol;
+    for (int j = 0; j < N; j++) {
+      if (s->is_free[j]) continue;
+      double mu = -q[j] - nu;
+      for (int k = 0; k < n; k++) mu += QQ(j, s->free[k]) * x[k];
+      if (mu + lmd < mumin) {
+        mumin = mu + lmd;
+        jmin = j;
+        smin = 1;
+      }
+      if (shorts && -mu + lmd < mumin) {
+        mumin = -mu + lmd;
+        jmin = j;
+        smin = -1;
+      }
+    }
+    if (jmin < 0) break;
+    s->sign[jmin] = smin;
+    sqp_add(s, jmin);
+  }
+  if (iter > maxiter) warning("the %s QP did not converge.", shorts ? "leverage-constrained" : "simplex-constrained");
+
+  s->has_w = 1;
+  s->iterations = iter;
+  memcpy(wout, w, sizeof(double) * N);
+  return iter;
+}
+
+#undef QQ
+#undef RR
+
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+static void simplex_QP_finalizer(SEXP ptr) {
+  sqp_free((simplex_qp *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+SEXP  simplex_QP_setup(SEXP QQ, SEXP LEVERAGE){
+  /*
+   arguments
+   QQ        : numeric N x N positive definite matrix, or numeric vector with the diagonal of a diagonal one
+   LEVERAGE  : number (>= 1), bound on sum(|w|)
+
+   returns an external pointer to a QP over the simplex (or over {sum(|w|) <= LEVERAGE, sum(w) == 1})
+   with Hessian QQ
+   */
+
+  int diag = !isMatrix(QQ);
+  int N = diag ? LENGTH(QQ) : nrows(QQ);
+  SEXP Q = PROTECT(coerceVector(QQ, REALSXP));
+  simplex_qp *s = sqp_alloc(N);
+  sqp_set_Q(s, REAL(Q), diag);
+  sqp_set_leverage(s, asReal(LEVERAGE));
+  SEXP ptr = PROTECT(R_MakeExternalPtr(s, install("simplex_qp"), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, simplex_QP_finalizer, TRUE);
+  UNPROTECT(2);
+  return ptr;
+}
+
+SEXP  simplex_QP_solve(SEXP PTR, SEXP QQ, SEXP QVEC){
+  /*
+   arguments
+   PTR       : external pointer returned by simplex_QP_setup
+   QQ        : NULL to keep the current Hessian, or a new one (same format as in simplex_QP_setup)
+   QVEC      : numeric vector, linear term
+
+   returns the solution, warm-starting from the solution of the previous call
+   */
+
+  simplex_qp *s = (simplex_qp *) R_ExternalPtrAddr(PTR);
+  if (!s) error("invalid simplex QP object.");
+  if (LENGTH(QVEC) != s->N) error("wrong length of the linear term.");
+  if (!isNull(QQ)) {
+    SEXP Q = PROTECT(coerceVector(QQ, REALSXP));
+    sqp_set_Q(s, REAL(Q), !isMatrix(QQ));
+    UNPROTECT(1);
+  }
+  SEXP res = PROTECT(allocVector(REALSXP, s->N));
+  sqp_solve(s, REAL(QVEC), REAL(res));
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP  simplex_QP_iterations(SEXP PTR){
+  /*
+   arguments
+   PTR       : external pointer returned by simplex_QP_setup
+
+   returns the number of active-set iterations of the last solve (0 for a diagonal Hessian)
+   */
+
+  simplex_qp *s = (simplex_qp *) R_ExternalPtrAddr(PTR);
+  if (!s) error("invalid simplex QP object.");
+  return ScalarInteger(s->iterations);
+}
+
+#endif
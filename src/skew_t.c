@@ -0,0 +1,337 @@
+// Portfolio moments of the generalized hyperbolic skew-t model and their derivatives.
+//
+// Under the skew-t model all four portfolio moments depend on w only through
+//   g = w'gamma,   u = Sigma w,   q = w'Sigma w,
+// so objective and gradients cost one symmetric matrix-vector product plus O(N) work. The
+// Hessians have the structure  H = U C U' + s Sigma  with U = [gamma, Sigma w] (N x 2), and are
+// returned in this factored form (the 2 x 2 matrix C and the scalar s for each moment).
+
+#include "highOrderPortfolios.h"
+#ifndef HOP_STANDALONE
+#include <R_ext/BLAS.h>
+#endif
+#include <math.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+// coefficients of the moments, in the order of the "a" list returned by estimate_skew_t()
+enum { A11, A21, A22, A31, A32, A41, A42, A43 };
+
+// objective (with the weights lmd), moments phi, 4 x N gradients of the moments (jac), gradient of the
+// objective, and u = Sigma w; if hess_coef is given, also the 3 x 4 factors of the Hessians (see skewt_eval())
+double skewt_moments(const skewt_model *m, const double *w, const double *lmd, double *phi, double *jac,
+                     double *grad, double *u, double *hess_coef) {
+  int N = m->N, one = 1;
+  const double *mu = m->mu, *gam = m->gamma, *a = m->a;
+  double dzero = 0.0, done = 1.0;
+
+  // the only O(N^2) operation
+  F77_CALL(dsymv)("U", &N, &done, m->scatter, &N, w, &one, &dzero, u, &one FCONE);
+
+  double g = 0.0, q = 0.0, m1 = 0.0;
+  for (int i = 0; i < N; i++) {
+    g += w[i] * gam[i];
+    q += w[i] * u[i];
+    m1 += w[i] * mu[i];
+  }
+  double g2 = g * g;
+
+  phi[0] = m1 + a[A11] * g;
+  phi[1] = a[A21] * q + a[A22] * g2;
+  phi[2] = a[A31] * g2 * g + a[A32] * g * q;
+  phi[3] = a[A41] * g2 * g2 + a[A42] * q * g2 + a[A43] * q * q;
+
+  // each gradient is a combination of gamma and Sigma w (plus mu for the mean)
+  double cg[4] = {a[A11], 2 * a[A22] * g, 3 * a[A31] * g2 + a[A32] * q, 4 * a[A41] * g2 * g + 2 * a[A42] * q * g};
+  double cu[4] = {0.0, 2 * a[A21], 2 * a[A32] * g, 2 * a[A42] * g2 + 4 * a[A43] * q};
+  double og = - lmd[0] * cg[0] + lmd[1] * cg[1] - lmd[2] * cg[2] + lmd[3] * cg[3];
+  double ou = lmd[1] * cu[1] - lmd[2] * cu[2] + lmd[3] * cu[3];
+
+  for (int i = 0; i < N; i++) {
+    jac[4 * i]     = mu[i] + cg[0] * gam[i];
+    jac[4 * i + 1] = cg[1] * gam[i] + cu[1] * u[i];
+    jac[4 * i + 2] = cg[2] * gam[i] + cu[2] * u[i];
+    jac[4 * i + 3] = cg[3] * gam[i] + cu[3] * u[i];
+    if (grad) grad[i] = - lmd[0] * mu[i] + og * gam[i] + ou * u[i];
+  }
+
+  if (hess_coef) {
+    // row k (H2, H3, H4): H = c11 gamma gamma' + c12 (gamma u' + u gamma') + c22 u u' + s Sigma
+    double *C = hess_coef;
+    C[0] = 2 * a[A22];                          C[3] = 0.0;
+    C[6] = 0.0;                                 C[9] = 2 * a[A21];
+    C[1] = 6 * a[A31] * g;                      C[4] = 2 * a[A32];
+    C[7] = 0.0;                                 C[10] = 2 * a[A32] * g;
+    C[2] = 12 * a[A41] * g2 + 2 * a[A42] * q;   C[5] = 4 * a[A42] * g;
+    C[8] = 8 * a[A43];                          C[11] = 2 * a[A42] * g2 + 4 * a[A43] * q;
+  }
+
+  return - lmd[0] * phi[0] + lmd[1] * phi[1] - lmd[2] * phi[2] + lmd[3] * phi[3];
+}
+
+
+// max_j |K0 + Kg g[j] + Kp sp[j] + Kq sq[j] + Ki si[j]|
+static inline double absmax_affine(int N, double K0, double Kg, const double *g, double Kp, const double *sp,
+                                   double Kq, const double *sq, double Ki, const double *si) {
+  double m = 0.0;
+  HOP_OMP(omp simd reduction(max:m))
+  for (int j = 0; j < N; j++) {
+    double v = fabs(K0 + Kg * g[j] + Kp * sp[j] + Kq * sq[j] + Ki * si[j]);
+    m = v > m ? v : m;
+  }
+  return m;
+}
+
+// the bounds (b2, b3, b4) on the Hessians of the variance, skewness, and kurtosis, see skewt_bounds()
+void skewt_hess_bounds(const skewt_model *m, int nthreads, double *b) {
+  int N = m->N;
+  const double *g = m->gamma, *S = m->scatter, *a = m->a;
+  double b2 = 0.0, b3 = 0.0, b4 = 0.0;
+
+  HOP_OMP(omp parallel for schedule(dynamic, 1) num_threads(nthreads) reduction(max:b2, b3, b4))
+  for (int p = 0; p < N; p++) {
+    const double *Sp = S + (R_xlen_t)p * N;
+    double r2 = 0.0, r3 = 0.0, r4 = 0.0;
+    for (int q = 0; q < N; q++) {
+      const double *Sq = S + (R_xlen_t)q * N;
+      double gpq = g[p] * g[q], Spq = Sp[q];
+      r2 += fabs(a[A21] * Spq + a[A22] * gpq);
+      // H3(e_i)[p, q] = 6 a31 g_i g_p g_q + 2 a32 (g_i S_pq + g_p S_iq + g_q S_pi)
+      r3 += absmax_affine(N, 0.0, 6 * a[A31] * gpq + 2 * a[A32] * Spq, g, 2 * a[A32] * g[q], Sp,
+                          2 * a[A32] * g[p], Sq, 0.0, Sq);
+      // H4(e_i, e_j)[p, q], as a function of j for each i
+      double m4 = 0.0;
+      for (int i = 0; i < N; i++) {
+        const double *Si = S + (R_xlen_t)i * N;
+        double Kg = 12 * a[A41] * g[i] * gpq + 2 * a[A42] * (g[i] * Spq + g[p] * Si[q]);
+        double Kp = 2 * a[A42] * g[i] * g[q] + 4 * a[A43] * Si[q];
+        double Kq = 2 * a[A42] * g[i] * g[p] + 4 * a[A43] * Si[p];
+        double Ki = 2 * a[A42] * gpq + 4 * a[A43] * Spq;
+        double mx = absmax_affine(N, 2 * a[A42] * g[i] * g[q] * Si[p], Kg, g, Kp, Sp, Kq, Sq, Ki, Si);
+        m4 = mx > m4 ? mx : m4;
+      }
+      r4 += m4;
+    }
+    b2 = r2 > b2 ? r2 : b2;
+    b3 = r3 > b3 ? r3 : b3;
+    b4 = r4 > b4 ? r4 : b4;
+  }
+  b[0] = 2 * b2;
+  b[1] = b3;
+  b[2] = b4;
+}
+
+
+// SCA loop of the L-MVSK and DC methods (same iterates as design_MVSK_portfolio_via_skew_t()): the QP
+// subproblems have the constant Hessian lmd2*H2 + rho*I (L-MVSK), with H2 = 2*(a21*Sigma + a22*gamma*gamma'),
+// or rho*I (DC), so the simplex QP keeps its factor (closed form for DC) and warm-starts each solve
+void skewt_sca_run(const skewt_model *m, const double *lmd, const sca_options *opt, simplex_qp *qp, double *w,
+                   sca_trace *tr) {
+  int N = m->N, maxiter = opt->maxiter, profile = tr->prof != NULL;
+  const double *gam = m->gamma, *S = m->scatter, *a = m->a;
+  double rho = opt->rho, start_time = hop_time(), t0 = 0.0, phi[4];
+  double *cpu_time = tr->cpu_time, *objs = tr->objs, *prof = tr->prof, *jac = tr->jac;
+
+  double *u = (double *) R_alloc(N, sizeof(double));
+  double *qk = (double *) R_alloc(N, sizeof(double));
+  double *w_old = (double *) R_alloc(N, sizeof(double));
+  if (opt->method == SKEWT_LMVSK) {
+    double *Q = (double *) R_alloc((size_t)N * N, sizeof(double));
+    for (int j = 0; j < N; j++)
+      for (int i = 0; i < N; i++)
+        Q[(R_xlen_t)j * N + i] = lmd[1] * (2 * (a[A21] * S[(R_xlen_t)j * N + i] + a[A22] * (gam[i] * gam[j]))) +
+                                 (i == j ? rho : 0.0);
+    sqp_set_Q(qp, Q, 0);
+  } else if (opt->method == SKEWT_DC) {
+    for (int i = 0; i < N; i++) qk[i] = rho;
+    sqp_set_Q(qp, qk, 1);
+  } else
+    error("Method unknown");
+  sqp_set_leverage(qp, 1.0);
+
+  if (profile) {
+    memset(prof, 0, sizeof(double) * 4 * ((size_t)maxiter + 1));
+    t0 = hop_time();
+  }
+  cpu_time[0] = 0.0;
+  objs[0] = skewt_moments(m, w, lmd, phi, jac, NULL, u, NULL);
+  if (profile) prof[0] = hop_time() - t0;
+
+  int iter, has_timed_out = 0;
+  for (iter = 1; iter <= maxiter; iter++) {
+    R_CheckUserInterrupt();
+    memcpy(w_old, w, sizeof(double) * N);
+
+    for (int i = 0; i < N; i++) {
+      const double *ji = jac + 4 * (R_xlen_t)i;
+      qk[i] = (opt->method == SKEWT_LMVSK) ? rho * w[i] + lmd[0] * ji[0] + lmd[2] * ji[2] - lmd[3] * ji[3] :
+        rho * w[i] + lmd[0] * ji[0] - lmd[1] * ji[1] + lmd[2] * ji[2] - lmd[3] * ji[3];
+    }
+    if (profile) t0 = hop_time();
+    int qp_iter = sqp_solve(qp, qk, w);
+    if (profile) {
+      prof[4 * iter + 2] = hop_time() - t0;
+      prof[4 * iter + 3] = qp_iter;
+    }
+    // as wk[wk < 0] <- 0; wk/sum(wk) (accumulated in long double, as sum() in R)
+    long double sw = 0.0;
+    for (int i = 0; i < N; i++) {
+      if (w[i] < 0) w[i] = 0.0;
+      sw += w[i];
+    }
+    for (int i = 0; i < N; i++) w[i] /= (double) sw;
+
+    // recording...
+    cpu_time[iter] = hop_time() - start_time;
+    if (profile) t0 = hop_time();
+    objs[iter] = skewt_moments(m, w, lmd, phi, jac, NULL, u, NULL);
+    if (profile) prof[4 * iter] = hop_time() - t0;
+
+    // termination criterion
+    long double dw = 0.0, nw = 0.0;
+    for (int i = 0; i < N; i++) {
+      dw += (w[i] - w_old[i]) * (w[i] - w_old[i]);
+      nw += w_old[i] * w_old[i];
+    }
+    int has_w_converged = sqrt((double) dw) / sqrt((double) nw) < opt->wtol;
+    int has_f_converged = fabs(objs[iter] - objs[iter - 1]) < opt->ftol;
+    int has_cross_stopval = objs[iter] <= opt->stopval;
+    if (isinf(opt->stopval)) {
+      if (has_w_converged && has_f_converged) break;
+    } else {
+      if (has_cross_stopval) break;
+    }
+    has_timed_out = hop_time() - start_time >= opt->maxtime;
+    if (has_timed_out) break;
+  }
+  tr->iterations = iter > maxiter ? maxiter : iter;
+  tr->timed_out = has_timed_out;
+}
+
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+static skewt_model skewt_model_get(SEXP MU, SEXP GAMMA, SEXP SCATTER, SEXP AA) {
+  skewt_model m = {LENGTH(GAMMA), REAL(MU), REAL(GAMMA), REAL(SCATTER), REAL(AA)};
+  return m;
+}
+
+SEXP  skewt_eval(SEXP WW, SEXP MU, SEXP GAMMA, SEXP SCATTER, SEXP AA, SEXP LAMBDA, SEXP HESS){
+  /*
+   arguments
+   WW        : numeric vector, portfolio weights
+   MU        : numeric vector, location
+   GAMMA     : numeric vector, skewness
+   SCATTER   : numeric N x N matrix, scatter
+   AA        : numeric vector with the coefficients (a11, a21, a22, a31, a32, a41, a42, a43)
+   LAMBDA    : numeric vector of length 4 with the weights of the moments
+   HESS      : logical, whether to return the factors of the Hessians
+
+   returns a list with the objective, the moments, the 4 x N matrix with the gradients of the
+   moments (jac), the gradient of the objective, and, if requested, the Hessian factors
+   */
+
+  skewt_model m = skewt_model_get(MU, GAMMA, SCATTER, AA);
+  int N = m.N;
+
+  const char *names[] = {"obj", "moments", "jac", "grad", "Sw", "hess_coef", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  double *u = REAL(SET_VECTOR_ELT(res, 4, allocVector(REALSXP, N)));
+  double *phi = REAL(SET_VECTOR_ELT(res, 1, allocVector(REALSXP, 4)));
+  double *jac = REAL(SET_VECTOR_ELT(res, 2, allocMatrix(REALSXP, 4, N)));
+  double *grad = REAL(SET_VECTOR_ELT(res, 3, allocVector(REALSXP, N)));
+  double *C = asLogical(HESS) ? REAL(SET_VECTOR_ELT(res, 5, allocMatrix(REALSXP, 3, 4))) : NULL;
+  SET_VECTOR_ELT(res, 0, ScalarReal(skewt_moments(&m, REAL(WW), REAL(LAMBDA), phi, jac, grad, u, C)));
+
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP  skewt_bounds(SEXP GAMMA, SEXP SCATTER, SEXP AA, SEXP NTHREADS){
+  /*
+   arguments
+   GAMMA     : numeric vector, skewness
+   SCATTER   : numeric N x N matrix, scatter
+   AA        : numeric vector with the coefficients (a11, a21, a22, a31, a32, a41, a42, a43)
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the bounds (b2, b3, b4) on the Hessians of the variance, skewness, and kurtosis: the
+   infinity norm of the elementwise maximum of |H(e_i)| over i (|H(e_i, e_j)| over i, j for the
+   kurtosis). Each element of those Hessians is affine in the entries of gamma and of one column of
+   the scatter matrix, so the maxima are accumulated on the fly without forming any matrix.
+   */
+
+  skewt_model m = skewt_model_get(GAMMA, GAMMA, SCATTER, AA);  // the location is not needed
+  SEXP res = PROTECT(allocVector(REALSXP, 3));
+  skewt_hess_bounds(&m, hop_num_threads(asInteger(NTHREADS)), REAL(res));
+  UNPROTECT(1);
+  return res;
+}
+
+static void skewt_qp_finalizer(SEXP ptr) {
+  sqp_free((simplex_qp *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+SEXP  MVSK_skewt_sca(SEXP LAMBDA, SEXP MU, SEXP GAMMA, SEXP SCATTER, SEXP AA, SEXP WINIT, SEXP METHOD, SEXP PARAMS,
+                     SEXP MAXITER, SEXP PROFILE){
+  /*
+   arguments
+   LAMBDA    : numeric vector of length 4, weights of the moments (normalized by their maximum)
+   MU, GAMMA : numeric vectors, location and skewness
+   SCATTER   : numeric N x N matrix, scatter
+   AA        : numeric vector with the coefficients (a11, a21, a22, a31, a32, a41, a42, a43)
+   WINIT     : numeric vector, initial portfolio
+   METHOD    : integer, 0 = "L-MVSK", 1 = "DC"
+   PARAMS    : numeric vector (rho, ftol, wtol, stopval, maxtime)
+   MAXITER   : integer, maximum number of iterations
+   PROFILE   : logical, whether to time the phases of each iteration
+
+   returns a list as MVSK_sca() (with the 4 x N gradients of the moments and the moments at the
+   solution, and with the time of the PSD approximation in the profile always 0)
+   */
+
+  skewt_model m = skewt_model_get(MU, GAMMA, SCATTER, AA);
+  int N = m.N, maxiter = asInteger(MAXITER);
+  const double *par = REAL(PARAMS);
+  sca_options opt = {asInteger(METHOD), maxiter, 1, 0.0, 1.0, 0.0, par[0], par[1], par[2], par[3], 1.0, par[4]};
+
+  simplex_qp *qp = sqp_alloc(N);
+  SEXP qp_ptr = PROTECT(R_MakeExternalPtr(qp, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(qp_ptr, skewt_qp_finalizer, TRUE);
+
+  const char *names[] = {"w", "cpu_time_vs_iterations", "objfun_vs_iterations", "iterations", "timed_out", "jac",
+                         "profile", "moments", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  SEXP W = SET_VECTOR_ELT(res, 0, duplicate(WINIT));
+  sca_trace tr;
+  tr.cpu_time = (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.objs = (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.prof = asLogical(PROFILE) == TRUE ? (double *) R_alloc(4 * ((size_t)maxiter + 1), sizeof(double)) : NULL;
+  tr.jac = REAL(SET_VECTOR_ELT(res, 5, allocMatrix(REALSXP, 4, N)));
+  skewt_sca_run(&m, REAL(LAMBDA), &opt, qp, REAL(W), &tr);
+  int iter = tr.iterations;
+
+  SEXP tm = SET_VECTOR_ELT(res, 1, allocVector(REALSXP, iter + 1));
+  SEXP ob = SET_VECTOR_ELT(res, 2, allocVector(REALSXP, iter + 1));
+  memcpy(REAL(tm), tr.cpu_time, sizeof(double) * (iter + 1));
+  memcpy(REAL(ob), tr.objs, sizeof(double) * (iter + 1));
+  SET_VECTOR_ELT(res, 3, ScalarInteger(iter));
+  SET_VECTOR_ELT(res, 4, ScalarLogical(tr.timed_out));
+  if (tr.prof) {
+    SEXP pr = SET_VECTOR_ELT(res, 6, allocMatrix(REALSXP, iter + 1, 4));
+    for (int k = 0; k <= iter; k++)
+      for (int c = 0; c < 4; c++) REAL(pr)[(R_xlen_t)c * (iter + 1) + k] = tr.prof[4 * k + c];
+  }
+  // moments at the solution (the gradients are already those of the last evaluation)
+  double *u = (double *) R_alloc(N, sizeof(double)), *jac = (double *) R_alloc(4 * (size_t)N, sizeof(double));
+  skewt_moments(&m, REAL(W), REAL(LAMBDA), REAL(SET_VECTOR_ELT(res, 7, allocVector(REALSXP, 4))), jac, NULL, u, NULL);
+
+  UNPROTECT(2);
+  return res;
+}
+
+#endif
@@ -0,0 +1,270 @@
+// EM estimation of the generalized hyperbolic skew-t model.
+//
+// With the mixing variable W_t ~ InvGamma(nu/2, nu/2), the observations are x_t | W_t ~ N(mu + W_t*gamma,
+// W_t*Sigma), and the posterior of W_t is the generalized inverse Gaussian GIG(-(nu + N)/2, nu + delta_t,
+// gamma'Sigma^-1 gamma), with delta_t the Mahalanobis distance of x_t - mu. Each iteration:
+//   - E-step: with the Cholesky factor Sigma = R'R, the whitened observations Z = (X - 1 mu') R^-1 come
+//     from one triangular solve (level-3 BLAS), and then, in parallel over the observations, the
+//     distances and E[1/W_t], E[W_t], E[log W_t] from ratios of Bessel functions K. The ratios are
+//     obtained by the (stable) forward recurrence in the order, so that the large orders (nu + N)/2 of
+//     many assets neither overflow nor need work buffers. The weights of an observation are kept while
+//     the arguments nu + delta_t, gamma'Sigma^-1 gamma, and nu of the GIG are within a relative ptol of
+//     those they were computed with (so they are always within about ptol of the exact ones).
+//   - M-step (ECM, as in McNeil, Frey, and Embrechts, Algorithm 3.14): closed-form mu, gamma, and
+//     Sigma, the latter from one symmetric rank-T update; with PX-EM, Sigma and gamma are rescaled by
+//     the mean of E[1/W_t] (the expansion of the scale of W_t); nu solves the one-dimensional
+//     stationarity equation, in [nu_lb, SKEWT_NU_MAX].
+// The convergence criteria are those of fitHeavyTail::fit_mvst (relative change of the parameters,
+// and optionally of the log-likelihood).
+
+#define USE_FC_LEN_T
+#include "highOrderPortfolios.h"
+#include <R_ext/BLAS.h>
+#include <R_ext/Lapack.h>
+#include <Rmath.h>
+#include <math.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+#define SKEWT_NU_MAX 100.0
+#define SKEWT_DNU 1e-4        // step of the derivative of log K in the order
+
+// log K_nu(s) (scaled by exp(s)), K_{nu+1}(s)/K_nu(s), and K_nu(s)/K_{nu-1}(s), by the recurrence
+// K_{v+1} = K_{v-1} + (2v/s) K_v from the fractional part of the order
+static double bessel_k_ratios(double nu, double s, double *r_up, double *r_down) {
+  double bk[2];
+  int m = (int) floor(nu);
+  double nu0 = nu - m;
+  double k0 = bessel_k_ex(s, nu0, 2.0, bk), r = bessel_k_ex(s, nu0 + 1, 2.0, bk) / k0;
+  double r_prev = k0 / bessel_k_ex(s, fabs(nu0 - 1), 2.0, bk), logk = log(k0);
+  for (int j = 1; j <= m; j++) {
+    logk += log(r);
+    r_prev = r;
+    r = 1.0 / r + 2 * (nu0 + j) / s;
+  }
+  if (r_up) *r_up = r;
+  if (r_down) *r_down = r_prev;
+  return logk;
+}
+
+// E[1/W], E[W], E[log W] for W ~ GIG(-a, chi, psi), i.e., with density proportional to
+// w^(-a-1) exp(-(chi/w + psi*w)/2), and log of 2 (chi/psi)^(-a/2) K_a(sqrt(chi*psi)) (the integral of
+// that function, for the log-likelihood)
+static void gig_moments(double a, double chi, double psi, double *e) {
+  double s = sqrt(chi * psi);
+  if (s < 1e-10) {  // inverse gamma(a, chi/2)
+    e[0] = 2 * a / chi;
+    e[1] = a > 1 ? chi / (2 * (a - 1)) : R_PosInf;
+    e[2] = log(chi / 2) - digamma(a);
+    e[3] = lgammafn(a) - a * log(chi / 2);
+    return;
+  }
+  double r_up, r_down, h = SKEWT_DNU * (a > 1 ? a : 1);
+  double logk = bessel_k_ratios(a, s, &r_up, &r_down);
+  e[0] = sqrt(psi / chi) * r_up;
+  e[1] = sqrt(chi / psi) / r_down;
+  // d/dlambda log K_lambda at lambda = -a is minus the derivative in the order at a
+  e[2] = 0.5 * log(chi / psi) - (bessel_k_ratios(a + h, s, NULL, NULL) - bessel_k_ratios(a - h, s, NULL, NULL)) / (2 * h);
+  e[3] = M_LN2 - 0.5 * a * log(chi / psi) + logk - s;
+}
+
+// stationarity of the expected complete log-likelihood in nu: log(nu/2) + 1 - digamma(nu/2) = c,
+// with c = mean(E[log W]) + mean(E[1/W]) (the left side decreases in nu)
+static double skewt_update_nu(double c, double nu_lb) {
+  double lo = nu_lb, hi = SKEWT_NU_MAX;
+  if (log(lo / 2) + 1 - digamma(lo / 2) <= c) return lo;
+  if (log(hi / 2) + 1 - digamma(hi / 2) >= c) return hi;
+  for (int it = 0; it < 100 && hi - lo > 1e-10 * lo; it++) {
+    double mid = sqrt(lo * hi);
+    if (log(mid / 2) + 1 - digamma(mid / 2) > c) lo = mid;
+    else hi = mid;
+  }
+  return sqrt(lo * hi);
+}
+
+// upper Cholesky factor of the N x N matrix S in R (lower triangle zeroed)
+static void skewt_chol(int N, const double *S, double *R) {
+  int info;
+  memcpy(R, S, sizeof(double) * (size_t)N * N);
+  F77_CALL(dpotrf)("U", &N, R, &N, &info FCONE);
+  if (info != 0) error("the scatter matrix is not positive definite (skew-t EM).");
+  for (int j = 0; j < N; j++)
+    for (int i = j + 1; i < N; i++) R[(R_xlen_t)j * N + i] = 0.0;
+}
+
+static int skewt_close(int n, const double *x, const double *x_prev, double tol) {
+  for (int i = 0; i < n; i++)
+    if (fabs(x[i] - x_prev[i]) > .5 * tol * (fabs(x[i]) + fabs(x_prev[i]))) return 0;
+  return 1;
+}
+
+// fit from the initial values in mu, gamma, S, and nu (overwritten by the estimates); returns the number
+// of iterations, and the last log-likelihood (if ftol is finite) and the fraction of skipped updates of
+// the observations in the E-step
+int skewt_em_fit(const double *X, int T, int N, double *mu, double *gam, double *S, double *nu_io, double nu_lb,
+                 int maxiter, double ptol, double ftol, int pxem, int nthreads, double *loglik_out, double *frozen_out) {
+  int one = 1;
+  double nu = *nu_io < nu_lb ? nu_lb : *nu_io, done = 1.0, dzero = 0.0;
+
+  double *R = (double *) R_alloc((size_t)N * N, sizeof(double));
+  double *Z = (double *) R_alloc((size_t)T * N, sizeof(double)), *g = (double *) R_alloc(N, sizeof(double));
+  double *xbar = (double *) R_alloc(N, sizeof(double)), *xd = (double *) R_alloc(N, sizeof(double));
+  double *mu_prev = (double *) R_alloc(N, sizeof(double)), *gam_prev = (double *) R_alloc(N, sizeof(double));
+  double *S_prev = (double *) R_alloc((size_t)N * N, sizeof(double));
+  // per observation: E[1/W], E[W], E[log W], the log of the integral over W, and the chi of these
+  double *Ew = (double *) R_alloc(4 * (size_t)T, sizeof(double)), *chi_w = (double *) R_alloc(T, sizeof(double));
+  double *skw = (double *) R_alloc(T, sizeof(double));
+  for (int j = 0; j < N; j++) {
+    double s = 0.0;
+    for (int t = 0; t < T; t++) s += X[(R_xlen_t)j * T + t];
+    xbar[j] = s / T;
+  }
+
+  double psi_w = -1.0, nu_w = -1.0, loglik = R_NegInf, loglik_prev;
+  double n_frozen = 0.0, n_updates = 0.0;
+  int iter;
+  for (iter = 1; iter <= maxiter; iter++) {
+    R_CheckUserInterrupt();
+    memcpy(mu_prev, mu, sizeof(double) * N);
+    memcpy(gam_prev, gam, sizeof(double) * N);
+    memcpy(S_prev, S, sizeof(double) * (size_t)N * N);
+    double nu_prev = nu;
+    loglik_prev = loglik;
+
+    // E-step: Z = (X - 1 mu') R^-1 and g = R'^-1 gamma, so delta_t = ||z_t||^2 and (x_t - mu)'Sigma^-1 gamma = z_t'g
+    skewt_chol(N, S, R);
+    HOP_OMP(omp parallel for schedule(static) num_threads(nthreads))
+    for (int j = 0; j < N; j++)
+      for (int t = 0; t < T; t++) Z[(R_xlen_t)j * T + t] = X[(R_xlen_t)j * T + t] - mu[j];
+    F77_CALL(dtrsm)("R", "U", "N", "N", &T, &N, &done, R, &N, Z, &T FCONE FCONE FCONE FCONE);
+    memcpy(g, gam, sizeof(double) * N);
+    F77_CALL(dtrsv)("U", "T", "N", &N, R, &N, g, &one FCONE FCONE FCONE);
+    double psi = 0.0, a = (nu + N) / 2;
+    for (int j = 0; j < N; j++) psi += g[j] * g[j];
+    // the weights computed with psi_w and nu_w can be kept (if also chi_w is close)
+    int keep = fabs(psi - psi_w) <= ptol * psi_w && fabs(nu - nu_w) <= ptol * nu_w;
+
+    double frozen = 0.0;
+    HOP_OMP(omp parallel for schedule(static) num_threads(nthreads) reduction(+:frozen))
+    for (int t = 0; t < T; t++) {
+      double d = 0.0, c = 0.0;
+      for (int j = 0; j < N; j++) {
+        double z = Z[(R_xlen_t)j * T + t];
+        d += z * z;
+        c += z * g[j];
+      }
+      skw[t] = c;
+      double chi = nu + d;
+      if (keep && fabs(chi - chi_w[t]) <= ptol * chi_w[t]) {
+        frozen += 1;
+        continue;
+      }
+      double e[4];
+      gig_moments(a, chi, psi, e);
+      Ew[t] = e[0]; Ew[T + t] = e[1]; Ew[2 * (size_t)T + t] = e[2]; Ew[3 * (size_t)T + t] = e[3];
+      chi_w[t] = chi;
+    }
+    if (!keep) {
+      psi_w = psi;
+      nu_w = nu;
+    }
+    n_frozen += frozen;
+    n_updates += T;
+
+    // log-likelihood at the current parameters
+    if (R_FINITE(ftol)) {
+      double ld = 0.0, s = 0.0;
+      for (int j = 0; j < N; j++) ld += log(R[(R_xlen_t)j * N + j]);
+      for (int t = 0; t < T; t++) s += skw[t] + Ew[3 * (size_t)T + t];
+      loglik = s + T * (-0.5 * N * log(2 * M_PI) - ld + 0.5 * nu * log(nu / 2) - lgammafn(nu / 2));
+    }
+
+    // M-step
+    double dbar = 0.0, ebar = 0.0, lbar = 0.0;
+    for (int t = 0; t < T; t++) {
+      dbar += Ew[t];
+      ebar += Ew[T + t];
+      lbar += Ew[2 * (size_t)T + t];
+    }
+    dbar /= T; ebar /= T; lbar /= T;
+    double invT = 1.0 / T;
+    F77_CALL(dgemv)("T", &T, &N, &invT, X, &T, Ew, &one, &dzero, xd, &one FCONE);  // mean(E[1/W_t] x_t)
+    double den = dbar * ebar - 1;
+    for (int j = 0; j < N; j++) {
+      gam[j] = den > 1e-12 ? (dbar * xbar[j] - xd[j]) / den : 0.0;
+      mu[j] = (xd[j] - gam[j]) / dbar;
+    }
+    HOP_OMP(omp parallel for schedule(static) num_threads(nthreads))
+    for (int j = 0; j < N; j++)
+      for (int t = 0; t < T; t++) Z[(R_xlen_t)j * T + t] = sqrt(Ew[t]) * (X[(R_xlen_t)j * T + t] - mu[j]);
+    F77_CALL(dsyrk)("U", "T", &N, &T, &invT, Z, &T, &dzero, S, &N FCONE FCONE);
+    for (int j = 0; j < N; j++)
+      for (int i = 0; i <= j; i++) {
+        double v = S[(R_xlen_t)j * N + i] - ebar * gam[i] * gam[j];
+        S[(R_xlen_t)j * N + i] = S[(R_xlen_t)i * N + j] = v;
+      }
+    if (pxem) {  // the expansion W -> W/mean(E[1/W]) of the mixing variable
+      for (R_xlen_t k = 0; k < (R_xlen_t)N * N; k++) S[k] /= dbar;
+      for (int j = 0; j < N; j++) gam[j] /= dbar;
+    }
+    nu = skewt_update_nu(lbar + dbar, nu_lb);
+
+    // termination criterion (as fitHeavyTail::fit_mvst)
+    int has_converged = skewt_close(N, mu, mu_prev, ptol) && skewt_close(N, gam, gam_prev, ptol) &&
+      skewt_close(N * N, S, S_prev, ptol) && skewt_close(1, &nu, &nu_prev, ptol);
+    if (R_FINITE(ftol) && iter > 1)
+      has_converged = has_converged || fabs(loglik - loglik_prev) <= .5 * ftol * (fabs(loglik) + fabs(loglik_prev));
+    if (has_converged) break;
+  }
+  if (iter > maxiter) iter = maxiter;
+
+  *nu_io = nu;
+  *loglik_out = loglik;
+  *frozen_out = n_updates > 0 ? n_frozen / n_updates : 0.0;
+  return iter;
+}
+
+SEXP  skew_t_em(SEXP XX, SEXP MU, SEXP GAMMA, SEXP SCATTER, SEXP NU, SEXP NULB, SEXP MAXITER, SEXP PTOL,
+                SEXP FTOL, SEXP PXEM, SEXP NTHREADS){
+  /*
+   arguments
+   XX        : numeric T x N matrix of observations
+   MU, GAMMA : numeric vectors, initial location and skewness
+   SCATTER   : numeric N x N matrix, initial scatter
+   NU        : number, initial degrees of freedom
+   NULB      : number, lower bound of the degrees of freedom
+   MAXITER   : integer, maximum number of iterations
+   PTOL      : number, relative tolerance on the change of the parameters
+   FTOL      : number, relative tolerance on the change of the log-likelihood (Inf to not use it)
+   PXEM      : logical, whether to use the parameter expansion
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns list(mu, gamma, scatter, nu, chol_Sigma, iterations, log_likelihood, frozen), frozen being the
+   fraction of the observation updates of the E-step that were skipped
+   */
+
+  int T = nrows(XX), N = ncols(XX);
+  if (LENGTH(MU) != N || LENGTH(GAMMA) != N || nrows(SCATTER) != N || ncols(SCATTER) != N)
+    error("the initial parameters do not correspond to %d assets.", N);
+  double nu = asReal(NU), loglik, frozen;
+
+  const char *names[] = {"mu", "gamma", "scatter", "nu", "chol_Sigma", "iterations", "log_likelihood", "frozen", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  double *mu = REAL(SET_VECTOR_ELT(res, 0, allocVector(REALSXP, N)));
+  double *gam = REAL(SET_VECTOR_ELT(res, 1, allocVector(REALSXP, N)));
+  double *S = REAL(SET_VECTOR_ELT(res, 2, allocMatrix(REALSXP, N, N)));
+  memcpy(mu, REAL(MU), sizeof(double) * N);
+  memcpy(gam, REAL(GAMMA), sizeof(double) * N);
+  memcpy(S, REAL(SCATTER), sizeof(double) * (size_t)N * N);
+  int iter = skewt_em_fit(REAL(XX), T, N, mu, gam, S, &nu, asReal(NULB), asInteger(MAXITER), asReal(PTOL), asReal(FTOL),
+                          asLogical(PXEM), hop_num_threads(asInteger(NTHREADS)), &loglik, &frozen);
+  SET_VECTOR_ELT(res, 3, ScalarReal(nu));
+  skewt_chol(N, S, REAL(SET_VECTOR_ELT(res, 4, allocMatrix(REALSXP, N, N))));
+  SET_VECTOR_ELT(res, 5, ScalarInteger(iter));
+  SET_VECTOR_ELT(res, 6, ScalarReal(loglik));
+  SET_VECTOR_ELT(res, 7, ScalarReal(frozen));
+  UNPROTECT(1);
+  return res;
+}
@@ -0,0 +1,168 @@
+// Sparse assembly of the SOCP subproblems of the Q-MVSKT method.
+//
+// The inequality constraints h - G*x (in the cone product) are stacked from blocks of rows: linear
+// constraints, and second-order cones from quadratic constraints x'LL'x + q'x + l <= 0 (as in
+// .QCQP2SOCP(), with rows q'/2, L', q'/2). Each block is converted once to compressed columns
+// (nonzeros only, as the dense-to-sparse conversion of the solver would), so the blocks that do not
+// change across iterations are reused and only the others are rebuilt; the assembly of the final
+// compressed-column matrix is then a merge of the columns of the blocks.
+
+#include "highOrderPortfolios.h"
+
+// a block of rows in compressed-column form: list(nrow, p, i, x, h)
+static SEXP socp_block_alloc(int nrow, int ncol, R_xlen_t nnz) {
+  const char *names[] = {"nrow", "p", "i", "x", "h", ""};
+  SEXP blk = PROTECT(mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(blk, 0, ScalarInteger(nrow));
+  SET_VECTOR_ELT(blk, 1, allocVector(INTSXP, ncol + 1));
+  SET_VECTOR_ELT(blk, 2, allocVector(INTSXP, nnz));
+  SET_VECTOR_ELT(blk, 3, allocVector(REALSXP, nnz));
+  SET_VECTOR_ELT(blk, 4, allocVector(REALSXP, nrow));
+  UNPROTECT(1);
+  return blk;
+}
+
+// keep the first nnz nonzeros of a block allocated for more
+static SEXP socp_block_shrink(SEXP blk, R_xlen_t nnz) {
+  if (XLENGTH(VECTOR_ELT(blk, 2)) == nnz) return blk;
+  SEXP i = PROTECT(allocVector(INTSXP, nnz)), x = PROTECT(allocVector(REALSXP, nnz));
+  memcpy(INTEGER(i), INTEGER(VECTOR_ELT(blk, 2)), sizeof(int) * nnz);
+  memcpy(REAL(x), REAL(VECTOR_ELT(blk, 3)), sizeof(double) * nnz);
+  SET_VECTOR_ELT(blk, 2, i);
+  SET_VECTOR_ELT(blk, 3, x);
+  UNPROTECT(2);
+  return blk;
+}
+
+SEXP  socp_block(SEXP GG, SEXP HH){
+  /*
+   arguments
+   GG        : numeric m x n matrix with rows of G (linear constraints h - G*x >= 0)
+   HH        : numeric vector of length m
+
+   returns the block in compressed-column form, list(nrow, p, i, x, h)
+   */
+
+  int m = nrows(GG), n = ncols(GG);
+  const double *G = REAL(GG);
+  SEXP blk = PROTECT(socp_block_alloc(m, n, (R_xlen_t)m * n));
+  int *p = INTEGER(VECTOR_ELT(blk, 1)), *ii = INTEGER(VECTOR_ELT(blk, 2));
+  double *x = REAL(VECTOR_ELT(blk, 3));
+  R_xlen_t nnz = 0;
+  p[0] = 0;
+  for (int j = 0; j < n; j++) {
+    for (int r = 0; r < m; r++) {
+      double v = G[(R_xlen_t)j * m + r];
+      if (v != 0.0) {
+        ii[nnz] = r;
+        x[nnz++] = v;
+      }
+    }
+    p[j + 1] = (int) nnz;
+  }
+  memcpy(REAL(VECTOR_ELT(blk, 4)), REAL(HH), sizeof(double) * m);
+  blk = socp_block_shrink(blk, nnz);
+  UNPROTECT(1);
+  return blk;
+}
+
+SEXP  socp_cone_block(SEXP QQ, SEXP LL, SEXP LMAT){
+  /*
+   arguments
+   QQ        : numeric vector of length n, linear term q
+   LL        : number, constant term l
+   LMAT      : numeric k x m matrix L (k <= n, the missing rows are zero)
+
+   returns the second-order cone of x'LL'x + q'x + l <= 0 in compressed-column form: the rows of G
+   are q'/2, L', q'/2 and h = ((1 - l)/2, 0, ..., 0, -(1 + l)/2)
+   */
+
+  int n = LENGTH(QQ), k = nrows(LMAT), m = ncols(LMAT);
+  if (k > n) error("the factor of the quadratic constraint has more rows than variables.");
+  const double *q = REAL(QQ), *L = REAL(LMAT);
+  double l = asReal(LL);
+  SEXP blk = PROTECT(socp_block_alloc(m + 2, n, (R_xlen_t)(m + 2) * n));
+  int *p = INTEGER(VECTOR_ELT(blk, 1)), *ii = INTEGER(VECTOR_ELT(blk, 2));
+  double *x = REAL(VECTOR_ELT(blk, 3)), *h = REAL(VECTOR_ELT(blk, 4));
+  R_xlen_t nnz = 0;
+  p[0] = 0;
+  for (int j = 0; j < n; j++) {
+    double qj = q[j] / 2;
+    if (qj != 0.0) {
+      ii[nnz] = 0;
+      x[nnz++] = qj;
+    }
+    if (j < k)
+      for (int c = 0; c < m; c++) {  // row c + 1 of G is column c of L
+        double v = L[(R_xlen_t)c * k + j];
+        if (v != 0.0) {
+          ii[nnz] = c + 1;
+          x[nnz++] = v;
+        }
+      }
+    if (qj != 0.0) {
+      ii[nnz] = m + 1;
+      x[nnz++] = qj;
+    }
+    p[j + 1] = (int) nnz;
+  }
+  memset(h, 0, sizeof(double) * (m + 2));
+  h[0] = (1 - l) / 2;
+  h[m + 1] = -(1 + l) / 2;
+  blk = socp_block_shrink(blk, nnz);
+  UNPROTECT(1);
+  return blk;
+}
+
+SEXP  socp_assemble(SEXP BLOCKS, SEXP NCOL){
+  /*
+   arguments
+   BLOCKS    : list of blocks returned by socp_block() or socp_cone_block(), in the order of the rows
+   NCOL      : integer, number of variables
+
+   returns list(p, i, x, h, nrow) with G in compressed-column form and the number of rows of each block
+   */
+
+  int nb = LENGTH(BLOCKS), n = asInteger(NCOL);
+  int *offset = (int *) R_alloc(nb, sizeof(int));
+  int nrow = 0;
+  R_xlen_t nnz = 0;
+  for (int b = 0; b < nb; b++) {
+    SEXP blk = VECTOR_ELT(BLOCKS, b);
+    if (LENGTH(VECTOR_ELT(blk, 1)) != n + 1) error("block %d does not have %d columns.", b + 1, n);
+    offset[b] = nrow;
+    nrow += asInteger(VECTOR_ELT(blk, 0));
+    nnz += XLENGTH(VECTOR_ELT(blk, 2));
+  }
+
+  const char *names[] = {"p", "i", "x", "h", "nrow", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  int *p = INTEGER(SET_VECTOR_ELT(res, 0, allocVector(INTSXP, n + 1)));
+  int *ii = INTEGER(SET_VECTOR_ELT(res, 1, allocVector(INTSXP, nnz)));
+  double *x = REAL(SET_VECTOR_ELT(res, 2, allocVector(REALSXP, nnz)));
+  double *h = REAL(SET_VECTOR_ELT(res, 3, allocVector(REALSXP, nrow)));
+  int *nrows_b = INTEGER(SET_VECTOR_ELT(res, 4, allocVector(INTSXP, nb)));
+
+  // column by column, the rows of the blocks one after the other (so the row indices stay sorted)
+  R_xlen_t k = 0;
+  p[0] = 0;
+  for (int j = 0; j < n; j++) {
+    for (int b = 0; b < nb; b++) {
+      SEXP blk = VECTOR_ELT(BLOCKS, b);
+      const int *bp = INTEGER(VECTOR_ELT(blk, 1)), *bi = INTEGER(VECTOR_ELT(blk, 2));
+      const double *bx = REAL(VECTOR_ELT(blk, 3));
+      for (int e = bp[j]; e < bp[j + 1]; e++) {
+        ii[k] = offset[b] + bi[e];
+        x[k++] = bx[e];
+      }
+    }
+    p[j + 1] = (int) k;
+  }
+  for (int b = 0; b < nb; b++) {
+    SEXP blk = VECTOR_ELT(BLOCKS, b);
+    nrows_b[b] = asInteger(VECTOR_ELT(blk, 0));
+    memcpy(h + offset[b], REAL(VECTOR_ELT(blk, 4)), sizeof(double) * nrows_b[b]);
+  }
+  UNPROTECT(1);
+  return res;
+}
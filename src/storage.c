@@ -0,0 +1,254 @@
+// Alternative storage of the co-skewness and co-kurtosis tensors.
+//
+// Besides the packed unique elements in double precision, the tensors can be kept
+//  - packed in single precision, halving the memory traffic of the kernels (which are bandwidth
+//    bound), with all the accumulations still in double precision (port_kernels_body.h), or
+//  - implicitly, through the T x N centered returns Xc: Phi = coef3 * sum_t x_t (x) x_t (x) x_t and
+//    Psi = coef4 * sum_t x_t (x) x_t (x) x_t (x) x_t. With r = Xc*w, the portfolio moments are then
+//    coef * sum_t r_t^k, their gradients k * coef * Xc'(r^(k-1)), and Phi*w (Psi*(w x w)) is
+//    coef * Xc' diag(r) Xc (coef * Xc' diag(r^2) Xc): O(T*N) instead of O(N^4) when T << N^2.
+//    These are matrix products with Xc and are done by the BLAS (level 3 for the Hessians and for
+//    batches of portfolios).
+
+#include "highOrderPortfolios.h"
+#ifndef HOP_STANDALONE
+#include <R_ext/BLAS.h>
+#endif
+#include <math.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+// conversion from the R objects (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+hop_comoment hop_comoment_get(SEXP X, int order, int P) {
+  hop_comoment c = {.kind = HOP_PACKED, .order = order, .coef = 1.0};
+  R_xlen_t n = (order == 3) ? n_unique3(P) : n_unique4(P);
+
+  if (TYPEOF(X) == RAWSXP) {
+    if (XLENGTH(X) != n * (R_xlen_t)sizeof(float))
+      error("the single-precision co-moments do not correspond to %d assets.", P);
+    c.kind = HOP_PACKED_FLOAT;
+    c.xf = (const float *) RAW(X);
+  } else if (TYPEOF(X) == REALSXP && isMatrix(X)) {
+    SEXP coef = getAttrib(X, install("coef"));
+    if (ncols(X) != P || TYPEOF(coef) != REALSXP || LENGTH(coef) != 2)
+      error("the implicit co-moments should be a T x %d matrix of centered returns with attribute \"coef\".", P);
+    c.kind = HOP_LOWRANK;
+    c.x = REAL(X);
+    c.T = nrows(X);
+    c.coef = REAL(coef)[order - 3];
+  } else if (TYPEOF(X) == REALSXP) {
+    if (XLENGTH(X) != n) error("the packed co-moments do not correspond to %d assets.", P);
+    c.x = REAL(X);
+  } else if (TYPEOF(X) == VECSXP)
+    c = factor_comoment_get(X, order, P);
+  else
+    error("unknown storage of the co-moments.");
+  return c;
+}
+#endif
+
+
+// r = Xc*w
+static void lowrank_scores(const hop_comoment *X, const double *W, int P, double *r) {
+  int T = X->T, one = 1;
+  double done = 1.0, dzero = 0.0;
+  F77_CALL(dgemv)("N", &T, &P, &done, X->x, &T, W, &one, &dzero, r, &one FCONE);
+}
+
+static inline double ipow(double r, int k) {
+  double p = 1.0;
+  for (int i = 0; i < k; i++) p *= r;
+  return p;
+}
+
+// portfolio skewness (kurtosis) coef * sum_t r_t^k and, if grad != NULL, its gradient
+double lowrank_port_kernel(const hop_comoment *X, const double *W, int P, double *grad) {
+  int T = X->T, k = X->order, one = 1;
+  double *r = (double *) R_alloc(T, sizeof(double));
+  lowrank_scores(X, W, P, r);
+
+  double val = 0.0;
+  for (int t = 0; t < T; t++) {
+    double p = ipow(r[t], k - 1);
+    val += p * r[t];
+    r[t] = k * X->coef * p;  // r is reused for the weights of the gradient
+  }
+
+  if (grad) {
+    double done = 1.0, dzero = 0.0;
+    F77_CALL(dgemv)("T", &T, &P, &done, X->x, &T, r, &one, &dzero, grad, &one FCONE);
+  }
+  return X->coef * val;
+}
+
+// copy the upper triangle of the P x P matrix H to the lower one
+static void mirror_upper(double *H, int P) {
+  for (int jj = 0; jj < P; jj++)
+    for (int ii = 0; ii < jj; ii++) H[(R_xlen_t)ii * P + jj] = H[(R_xlen_t)jj * P + ii];
+}
+
+// H = coef * Xc' diag(v) Xc from the scores r, with v = r^(k-2): a symmetric rank-T update,
+// from the scaled returns sqrt(v)*Xc when v >= 0 (kurtosis) and as a rank-2T one otherwise
+static void lowrank_hess_from_scores(const hop_comoment *X, const double *r, int P, int nthreads, double *H) {
+  int T = X->T;
+  double *Y = (double *) R_alloc((size_t)T * P, sizeof(double));
+  double dzero = 0.0;
+
+  HOP_OMP(omp parallel for schedule(static) num_threads(nthreads))
+  for (int jj = 0; jj < P; jj++) {
+    const double *xj = X->x + (R_xlen_t)jj * T;
+    double *yj = Y + (R_xlen_t)jj * T;
+    if (X->order == 4)
+      for (int t = 0; t < T; t++) yj[t] = fabs(r[t]) * xj[t];
+    else
+      for (int t = 0; t < T; t++) yj[t] = r[t] * xj[t];
+  }
+
+  if (X->order == 4) {
+    double alpha = X->coef;
+    F77_CALL(dsyrk)("U", "T", &P, &T, &alpha, Y, &T, &dzero, H, &P FCONE FCONE);
+  } else {
+    double alpha = 0.5 * X->coef;
+    F77_CALL(dsyr2k)("U", "T", &P, &T, &alpha, X->x, &T, Y, &T, &dzero, H, &P FCONE FCONE);
+  }
+  mirror_upper(H, P);
+}
+
+// H = coef * Xc' diag(r^(k-2)) Xc, i.e., Phi*w (Psi*(w x w)) as in M3port_hess_kernel (M4port_hess_kernel)
+void lowrank_port_hess_kernel(const hop_comoment *X, const double *W, int P, int nthreads, double *H) {
+  double *r = (double *) R_alloc(X->T, sizeof(double));
+  lowrank_scores(X, W, P, r);
+  lowrank_hess_from_scores(X, r, P, nthreads, H);
+}
+
+// skewness and kurtosis of the K portfolios in the columns of W, from the scores R = Xc*W (shared
+// when both tensors are implied by the same returns)
+void lowrank_port_batch_kernel(const hop_comoment *X3, const hop_comoment *X4, const double *W, int P, int K,
+                               int nthreads, double *skew, double *kurt) {
+  int shared = (X3->x == X4->x && X3->T == X4->T);
+  double done = 1.0, dzero = 0.0;
+
+  for (int m = 0; m < 2 - shared; m++) {
+    const hop_comoment *X = (m == 0) ? X3 : X4;
+    int T = X->T;
+    double *R = (double *) R_alloc((size_t)T * K, sizeof(double));
+    F77_CALL(dgemm)("N", "N", &T, &K, &P, &done, X->x, &T, W, &P, &dzero, R, &T FCONE FCONE);
+
+    HOP_OMP(omp parallel for schedule(static) num_threads(nthreads))
+    for (int k = 0; k < K; k++) {
+      const double *r = R + (R_xlen_t)k * T;
+      double s3 = 0.0, s4 = 0.0;
+      for (int t = 0; t < T; t++) {
+        double r2 = r[t] * r[t];
+        s3 += r2 * r[t];
+        s4 += r2 * r2;
+      }
+      if (m == 0) skew[k] = X3->coef * s3;
+      if (m == 1 || shared) kurt[k] = X4->coef * s4;
+    }
+  }
+}
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+SEXP  lowrank_derivs(SEXP WW, SEXP XX, SEXP HESS, SEXP NTHREADS){
+  /*
+   arguments
+   WW        : numeric vector with the portfolio weights
+   XX        : numeric T x N matrix with the centered returns, with attribute "coef" (see hop_comoment)
+   HESS      : logical, whether to compute the Hessians as well
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+
+   returns the portfolio skewness and kurtosis with their gradients (and Hessians) from a single
+   product r = Xc*w, the two gradients in one product Xc'[3*coef3*r^2, 4*coef4*r^3]
+   */
+
+  int P = ncols(XX), nthreads = hop_num_threads(asInteger(NTHREADS)), with_hess = asLogical(HESS);
+  hop_comoment X3 = hop_comoment_get(XX, 3, P), X4 = hop_comoment_get(XX, 4, P);
+  if (X3.kind != HOP_LOWRANK) error("the co-moments should be implied by the centered returns.");
+  int T = X3.T, two = 2;
+  double *r = (double *) R_alloc(T, sizeof(double));
+  double *Pw = (double *) R_alloc(2 * (size_t)T, sizeof(double));
+  lowrank_scores(&X3, REAL(WW), P, r);
+
+  double s3 = 0.0, s4 = 0.0;
+  for (int t = 0; t < T; t++) {
+    double r2 = r[t] * r[t];
+    s3 += r2 * r[t];
+    s4 += r2 * r2;
+    Pw[t] = 3 * X3.coef * r2;
+    Pw[T + t] = 4 * X4.coef * r2 * r[t];
+  }
+
+  const char *names[] = {"value", "grad3", "grad4", "hess3", "hess4", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  double *value = REAL(SET_VECTOR_ELT(res, 0, allocVector(REALSXP, 2)));
+  value[0] = X3.coef * s3;
+  value[1] = X4.coef * s4;
+  double *G = (double *) R_alloc(2 * (size_t)P, sizeof(double)), done = 1.0, dzero = 0.0;
+  F77_CALL(dgemm)("T", "N", &P, &two, &T, &done, X3.x, &T, Pw, &T, &dzero, G, &P FCONE FCONE);
+  memcpy(REAL(SET_VECTOR_ELT(res, 1, allocVector(REALSXP, P))), G, sizeof(double) * P);
+  memcpy(REAL(SET_VECTOR_ELT(res, 2, allocVector(REALSXP, P))), G + P, sizeof(double) * P);
+
+  if (with_hess) {
+    double *H3 = REAL(SET_VECTOR_ELT(res, 3, allocMatrix(REALSXP, P, P)));
+    double *H4 = REAL(SET_VECTOR_ELT(res, 4, allocMatrix(REALSXP, P, P)));
+    X3.coef *= 6;   // the Hessians are 6*Phi*w and 12*Psi*(w x w)
+    X4.coef *= 12;
+    lowrank_hess_from_scores(&X3, r, P, nthreads, H3);
+    lowrank_hess_from_scores(&X4, r, P, nthreads, H4);
+  }
+  UNPROTECT(1);
+  return res;
+}
+
+
+SEXP  comoments_to_float(SEXP XX){
+  /*
+   arguments
+   XX        : numeric vector with unique elements of a coskewness or cokurtosis matrix
+
+   returns a list with the elements in single precision (the bits in a raw vector) and the
+   maximum absolute rounding error relative to the largest element
+   */
+
+  R_xlen_t n = XLENGTH(XX);
+  const double *x = REAL(XX);
+  const char *names[] = {"x", "error", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  float *xf = (float *) RAW(SET_VECTOR_ELT(res, 0, allocVector(RAWSXP, n * (R_xlen_t)sizeof(float))));
+
+  double max_abs = 0.0, max_err = 0.0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    xf[i] = (float) x[i];
+    double e = fabs(x[i] - (double) xf[i]), a = fabs(x[i]);
+    if (e > max_err) max_err = e;
+    if (a > max_abs) max_abs = a;
+  }
+  SET_VECTOR_ELT(res, 1, ScalarReal(max_abs > 0 ? max_err / max_abs : 0.0));
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP  comoments_from_float(SEXP XX){
+  /*
+   arguments
+   XX        : raw vector with unique elements of a coskewness or cokurtosis matrix in single precision
+
+   returns the elements in double precision
+   */
+
+  R_xlen_t n = XLENGTH(XX) / (R_xlen_t)sizeof(float);
+  const float *xf = (const float *) RAW(XX);
+  SEXP res = PROTECT(allocVector(REALSXP, n));
+  double *x = REAL(res);
+  for (R_xlen_t i = 0; i < n; i++) x[i] = xf[i];
+  UNPROTECT(1);
+  return res;
+}
+
+#endif
@@ -0,0 +1,684 @@
+// Native loop of the "L-MVSKT" method of design_MVSKtilting_portfolio_via_sample_moments() (same
+// iterates as the R implementation), with the LP that enlarges the feasible set and the QP of the
+// approximating problem solved by dedicated solvers instead of lpSolveAPI and quadprog.
+//
+// Both subproblems are over x = (w, delta), with w in the signed split (w+, w-) when leverage > 1,
+// subject to x >= 0, sum(w) == 1, the five linearized constraints f_i'x >= b_i (tracking error and
+// the four moments, the rows of f.con in the R implementation), and sum(w+) + sum(w-) <= leverage.
+// With so few general constraints:
+//  - the LP (minimize t subject to f_i'x + t >= b_i) is solved by a revised simplex keeping the dense
+//    inverse of its basis (at most 7 x 7). The optimal basis carries over to the next iteration: once
+//    refactorized for the new rows, the primal simplex resumes from it if it is still primal feasible
+//    and the dual simplex if it is still dual feasible (a crash basis is used otherwise).
+//  - the QP (minimize 0.5*x'Dx - dvec'x subject to f_i'x >= b_i - eta) has a diagonal Hessian D, so
+//    each step of a primal active-set method only solves the small system A_W D^-1 A_W' of the general
+//    constraints in the working set over the free variables. It starts from theta*x_LP + (1-theta)*x_k,
+//    which is feasible by the definition of eta (x_k itself when eta == 0), so that the variables at zero
+//    in the current iterate start in the working set.
+// Every iterate of both solvers is feasible, so when one stops early (iteration limit, unbounded ray, or
+// degenerate working set) the loop goes on from its last iterate, and the exit status is reported.
+
+#include "highOrderPortfolios.h"
+#include <math.h>
+
+#define TLT_MAXROWS 7
+
+// The general rows over x = (w, delta): 0 is sum(w) == 1, 1-5 are f.con, and 6 (only when
+// leverage > 1) is sum(w+) + sum(w-) <= leverage. A is dense and row-major, m x n.
+typedef struct {
+  int N, n_w, n, m;   // assets, weight variables (N or 2N), variables (n_w + 1), rows
+  double leverage;
+  double *A;
+} tilt_rows;
+
+// fill A from the 5 x (N+1) matrix F of f.con (column-major)
+static void tilt_rows_set(tilt_rows *P, const double *F) {
+  int N = P->N, n = P->n;
+  for (int r = 0; r < P->m; r++) {
+    double *a = P->A + (R_xlen_t)r * n;
+    for (int j = 0; j < P->n_w; j++) {
+      int k = j % N;
+      double s = j < N ? 1.0 : -1.0;
+      a[j] = (r == 0) ? s : (r == 6) ? 1.0 : s * F[(R_xlen_t)k * 5 + r - 1];
+    }
+    a[P->n_w] = (r >= 1 && r <= 5) ? F[(R_xlen_t)N * 5 + r - 1] : 0.0;
+  }
+}
+
+
+// LP ----------------------------------------------------------------------------------------------------
+// Columns: the n variables x, then t, then the slacks of rows 1-5 (f_i'x + t - s_i == b_i) and of
+// row 6 (sum(w+) + sum(w-) + s == leverage).
+
+typedef struct {
+  int ncol;
+  int basis[TLT_MAXROWS];
+  int has_basis;
+  double Binv[TLT_MAXROWS * TLT_MAXROWS];  // row-major: Binv[i*m + r] = (B^-1)[i, r]
+  double xB[TLT_MAXROWS];
+  int *is_basic;
+  int iterations, warm;  // of the last solve; warm is 0 (crash basis), 1 (primal), or 2 (dual simplex)
+  int status;
+} tilt_lp;
+
+static void lp_column(const tilt_rows *P, int j, double *col) {
+  int m = P->m;
+  for (int r = 0; r < m; r++) col[r] = 0.0;
+  if (j < P->n)
+    for (int r = 0; r < m; r++) col[r] = P->A[(R_xlen_t)r * P->n + j];
+  else if (j == P->n)
+    for (int r = 1; r <= 5; r++) col[r] = 1.0;
+  else {
+    int k = j - P->n - 1;
+    col[1 + k] = (k < 5) ? -1.0 : 1.0;
+  }
+}
+
+// inverse of the basis matrix (Gauss-Jordan with partial pivoting) and basic solution; 0 if singular
+static int lp_factor(const tilt_rows *P, tilt_lp *lp, const double *b) {
+  int m = P->m;
+  double B[TLT_MAXROWS * TLT_MAXROWS], col[TLT_MAXROWS];
+  for (int i = 0; i < m; i++) {
+    lp_column(P, lp->basis[i], col);
+    for (int r = 0; r < m; r++) B[r * m + i] = col[r];
+  }
+  double *Bi = lp->Binv;
+  for (int r = 0; r < m * m; r++) Bi[r] = 0.0;
+  for (int r = 0; r < m; r++) Bi[r * m + r] = 1.0;
+  for (int c = 0; c < m; c++) {
+    int piv = c;
+    for (int r = c + 1; r < m; r++) if (fabs(B[r * m + c]) > fabs(B[piv * m + c])) piv = r;
+    if (fabs(B[piv * m + c]) < 1e-12) return 0;
+    for (int k = 0; k < m; k++) {
+      double t = B[c * m + k]; B[c * m + k] = B[piv * m + k]; B[piv * m + k] = t;
+      t = Bi[c * m + k]; Bi[c * m + k] = Bi[piv * m + k]; Bi[piv * m + k] = t;
+    }
+    double d = B[c * m + c];
+    for (int k = 0; k < m; k++) { B[c * m + k] /= d; Bi[c * m + k] /= d; }
+    for (int r = 0; r < m; r++) {
+      if (r == c || B[r * m + c] == 0.0) continue;
+      double f = B[r * m + c];
+      for (int k = 0; k < m; k++) { B[r * m + k] -= f * B[c * m + k]; Bi[r * m + k] -= f * Bi[c * m + k]; }
+    }
+  }
+  for (int i = 0; i < m; i++) {
+    double s = 0.0;
+    for (int r = 0; r < m; r++) s += Bi[i * m + r] * b[r];
+    lp->xB[i] = s;
+  }
+  for (int j = 0; j < lp->ncol; j++) lp->is_basic[j] = 0;
+  for (int i = 0; i < m; i++) lp->is_basic[lp->basis[i]] = 1;
+  return 1;
+}
+
+// simplex multipliers y = c_B' B^-1 (the only cost is that of t)
+static void lp_duals(const tilt_rows *P, const tilt_lp *lp, double *y) {
+  int m = P->m;
+  for (int r = 0; r < m; r++) y[r] = 0.0;
+  for (int i = 0; i < m; i++)
+    if (lp->basis[i] == P->n)
+      for (int r = 0; r < m; r++) y[r] = lp->Binv[i * m + r];
+}
+
+// reduced cost of column j (and its scale, for the tolerances)
+static double lp_reduced_cost(const tilt_rows *P, int j, const double *y, double *col, double *scale) {
+  lp_column(P, j, col);
+  double s = 0.0;
+  *scale = 1.0;
+  for (int r = 0; r < P->m; r++) { s += y[r] * col[r]; *scale += fabs(y[r] * col[r]); }
+  return (j == P->n) - s;
+}
+
+static void lp_pivot(const tilt_rows *P, tilt_lp *lp, int p, int q, const double *u) {
+  int m = P->m;
+  double *Bp = lp->Binv + p * m;
+  for (int r = 0; r < m; r++) Bp[r] /= u[p];
+  lp->xB[p] /= u[p];
+  for (int i = 0; i < m; i++) {
+    if (i == p || u[i] == 0.0) continue;
+    for (int r = 0; r < m; r++) lp->Binv[i * m + r] -= u[i] * Bp[r];
+    lp->xB[i] -= u[i] * lp->xB[p];
+  }
+  lp->is_basic[lp->basis[p]] = 0;
+  lp->basis[p] = q;
+  lp->is_basic[q] = 1;
+  lp->iterations++;
+}
+
+static void lp_ftran(const tilt_rows *P, const tilt_lp *lp, const double *col, double *u) {
+  int m = P->m;
+  for (int i = 0; i < m; i++) {
+    double s = 0.0;
+    for (int r = 0; r < m; r++) s += lp->Binv[i * m + r] * col[r];
+    u[i] = s;
+  }
+}
+
+// primal simplex from a primal feasible basis (Dantzig's rule, Bland's rule after degenerate pivots),
+// which stays primal feasible whatever the status
+static int lp_primal(const tilt_rows *P, tilt_lp *lp, double tol) {
+  int m = P->m, degenerate = 0, maxit = 50 * (lp->ncol + m);
+  double y[TLT_MAXROWS], col[TLT_MAXROWS], u[TLT_MAXROWS];
+  for (int it = 0; it < maxit; it++) {
+    int bland = degenerate > 2 * m, q = -1;
+    double best = -1e-12;
+    lp_duals(P, lp, y);
+    for (int j = 0; j < lp->ncol; j++) {
+      if (lp->is_basic[j]) continue;
+      double scale, d = lp_reduced_cost(P, j, y, col, &scale) / scale;
+      if (d < best) {
+        q = j;
+        best = d;
+        if (bland) break;
+      }
+    }
+    if (q < 0) return TILT_OPTIMAL;
+    lp_column(P, q, col);
+    lp_ftran(P, lp, col, u);
+    double umax = 0.0, ratio = R_PosInf;
+    int p = -1;
+    for (int i = 0; i < m; i++) umax = fmax(umax, fabs(u[i]));
+    for (int i = 0; i < m; i++)
+      if (u[i] > 1e-9 * umax) {
+        double r = fmax(lp->xB[i], 0.0) / u[i];
+        if (r < ratio || (r == ratio && lp->basis[i] < lp->basis[p])) { ratio = r; p = i; }
+      }
+    if (p < 0) return TILT_UNBOUNDED;
+    degenerate = (ratio <= tol) ? degenerate + 1 : 0;
+    lp_pivot(P, lp, p, q, u);
+  }
+  return TILT_SUBOPTIMAL;
+}
+
+// dual simplex from a dual feasible basis
+static int lp_dual(const tilt_rows *P, tilt_lp *lp, double tol) {
+  int m = P->m, maxit = 50 * (lp->ncol + m);
+  double y[TLT_MAXROWS], col[TLT_MAXROWS], u[TLT_MAXROWS];
+  for (int it = 0; it < maxit; it++) {
+    int p = -1;
+    for (int i = 0; i < m; i++) if (lp->xB[i] < -tol && (p < 0 || lp->xB[i] < lp->xB[p])) p = i;
+    if (p < 0) return TILT_OPTIMAL;
+    lp_duals(P, lp, y);
+    int q = -1;
+    double ratio = R_PosInf;
+    for (int j = 0; j < lp->ncol; j++) {
+      if (lp->is_basic[j]) continue;
+      double dscale, d = lp_reduced_cost(P, j, y, col, &dscale), alpha = 0.0, scale = 0.0;
+      for (int r = 0; r < m; r++) { alpha += lp->Binv[p * m + r] * col[r]; scale += fabs(lp->Binv[p * m + r] * col[r]); }
+      if (alpha < -1e-9 * scale) {
+        double rt = fmax(d, 0.0) / -alpha;
+        if (rt < ratio) { ratio = rt; q = j; }
+      }
+    }
+    if (q < 0) return TILT_INFEASIBLE;
+    lp_column(P, q, col);
+    lp_ftran(P, lp, col, u);
+    lp_pivot(P, lp, p, q, u);
+  }
+  return TILT_SUBOPTIMAL;
+}
+
+// basis with w_a = 1 (a the largest weight of the current iterate), t on the most violated row (if any),
+// and the slacks of the other rows: primal feasible and nonsingular
+static void lp_crash(const tilt_rows *P, tilt_lp *lp, const double *b, const double *w) {
+  int a = 0, worst = -1;
+  for (int k = 1; k < P->N; k++) if (w[k] > w[a]) a = k;
+  double viol = 0.0;
+  for (int r = 1; r <= 5; r++) {
+    double v = b[r] - P->A[(R_xlen_t)r * P->n + a];
+    if (v > viol) { viol = v; worst = r; }
+  }
+  lp->basis[0] = a;
+  for (int r = 1; r < P->m; r++) lp->basis[r] = (r == worst) ? P->n : P->n + r;
+}
+
+// minimum t (returned) and the x of the optimal basic solution, or of the last basic solution of the
+// primal simplex if it stopped early (lp->status)
+static double lp_solve(const tilt_rows *P, tilt_lp *lp, const double *b, const double *w, double *x) {
+  int m = P->m;
+  double tol = 1e-11, y[TLT_MAXROWS], col[TLT_MAXROWS];
+  lp->iterations = 0;
+  lp->warm = 0;
+  if (lp->has_basis && lp_factor(P, lp, b)) {
+    int primal = 1, dual = 1;
+    for (int i = 0; i < m; i++) if (lp->xB[i] < -tol) primal = 0;
+    if (!primal) {
+      lp_duals(P, lp, y);
+      for (int j = 0; j < lp->ncol && dual; j++) {
+        double scale;
+        if (!lp->is_basic[j] && lp_reduced_cost(P, j, y, col, &scale) < -1e-12 * scale) dual = 0;
+      }
+    }
+    if (primal) lp->warm = 1;
+    else if (dual) {
+      lp->warm = 2;
+      if (lp_dual(P, lp, tol) != TILT_OPTIMAL) lp->warm = 0;  // (the LP is always feasible) from a crash basis
+    }
+  }
+  if (!lp->warm) {
+    lp_crash(P, lp, b, w);
+    if (!lp_factor(P, lp, b)) error("the crash basis of the LP of L-MVSKT is singular.");
+  }
+  lp->status = lp_primal(P, lp, tol);
+  lp->has_basis = 1;
+
+  double t = 0.0;
+  for (int j = 0; j < P->n; j++) x[j] = 0.0;
+  for (int i = 0; i < m; i++) {
+    int j = lp->basis[i];
+    if (j < P->n) x[j] = fmax(lp->xB[i], 0.0);
+    else if (j == P->n) t = fmax(lp->xB[i], 0.0);
+  }
+  return t;
+}
+
+
+// QP ----------------------------------------------------------------------------------------------------
+// Rows as in A, with row 6 negated (-sum(w+) - sum(w-) >= -leverage), all >= except row 0. The rows
+// are of very different scales (the gradients of the moments), so they are normalized in the working
+// set system and the multipliers lam are those of the normalized rows.
+
+typedef struct {
+  double *x, *xs;  // n, iterate and minimizer over the working set
+  int *fixed;      // n flags: at the bound 0 and in the working set
+  double scale[TLT_MAXROWS];  // inverse norms of the rows
+  int iterations, status;
+} tilt_qp;
+
+static inline double qp_coef(const tilt_rows *P, int r, int j) {
+  double a = P->A[(R_xlen_t)r * P->n + j];
+  return r == 6 ? -a : a;
+}
+
+// solve LL'x = g for the Cholesky factor L in the lower triangle of M (k x k)
+static void chol_solve(const double *M, int k, const double *g, double *x) {
+  for (int s = 0; s < k; s++) {
+    double v = g[s];
+    for (int c = 0; c < s; c++) v -= M[s * k + c] * x[c];
+    x[s] = v / M[s * k + s];
+  }
+  for (int s = k - 1; s >= 0; s--) {
+    double v = x[s];
+    for (int c = s + 1; c < k; c++) v -= M[c * k + s] * x[c];
+    x[s] = v / M[s * k + s];
+  }
+}
+
+// minimizer xs over the working set {rows in W, fixed variables} and the multipliers lam of the rows;
+// 0 if the rows in the working set are degenerate
+static int qp_eqp(const tilt_rows *P, tilt_qp *qp, const int *W, int k, const double *D, const double *dvec,
+                   const double *b, double *lam) {
+  double M[TLT_MAXROWS * TLT_MAXROWS], g[TLT_MAXROWS];
+  for (int s = 0; s < k; s++) {
+    g[s] = b[W[s]] * qp->scale[W[s]];
+    for (int t = 0; t < k; t++) M[s * k + t] = 0.0;
+  }
+  for (int j = 0; j < P->n; j++) {
+    if (qp->fixed[j]) continue;
+    double a[TLT_MAXROWS];
+    for (int s = 0; s < k; s++) a[s] = qp_coef(P, W[s], j) * qp->scale[W[s]];
+    for (int s = 0; s < k; s++) {
+      g[s] -= a[s] * dvec[j] / D[j];
+      for (int t = 0; t <= s; t++) M[s * k + t] += a[s] * a[t] / D[j];
+    }
+  }
+  // Cholesky M = LL' (lower triangle)
+  for (int s = 0; s < k; s++) {
+    for (int t = 0; t <= s; t++) {
+      double v = M[s * k + t];
+      for (int c = 0; c < t; c++) v -= M[s * k + c] * M[t * k + c];
+      if (t == s) {
+        if (v <= 0.0) return 0;
+        M[s * k + s] = sqrt(v);
+      } else
+        M[s * k + t] = v / M[t * k + t];
+    }
+  }
+  chol_solve(M, k, g, lam);
+  for (int j = 0; j < P->n; j++) {
+    if (qp->fixed[j]) { qp->xs[j] = 0.0; continue; }
+    double v = dvec[j];
+    for (int s = 0; s < k; s++) v += lam[s] * qp_coef(P, W[s], j) * qp->scale[W[s]];
+    qp->xs[j] = v / D[j];
+  }
+
+  // one step of iterative refinement on the residual of the working set rows
+  double dl[TLT_MAXROWS];
+  for (int s = 0; s < k; s++) {
+    double v = b[W[s]];
+    for (int j = 0; j < P->n; j++) v -= qp_coef(P, W[s], j) * qp->xs[j];
+    g[s] = v * qp->scale[W[s]];
+  }
+  chol_solve(M, k, g, dl);
+  for (int s = 0; s < k; s++) lam[s] += dl[s];
+  for (int j = 0; j < P->n; j++) {
+    if (qp->fixed[j]) continue;
+    double v = 0.0;
+    for (int s = 0; s < k; s++) v += dl[s] * qp_coef(P, W[s], j) * qp->scale[W[s]];
+    qp->xs[j] += v / D[j];
+  }
+  return 1;
+}
+
+// primal active-set method from the feasible point in qp->x, which stays feasible whatever the status
+static int qp_solve(const tilt_rows *P, tilt_qp *qp, const double *D, const double *dvec, const double *b) {
+  int n = P->n, m = P->m, maxit = 10 * (n + m);
+  int inW[TLT_MAXROWS] = {1, 0, 0, 0, 0, 0, 0}, W[TLT_MAXROWS], k;
+  double lam[TLT_MAXROWS], tol = 1e-12 * (1.0 + fabs(dvec[n - 1]));
+  for (int j = 0; j < n; j++) {
+    qp->fixed[j] = qp->x[j] <= 0.0;
+    if (qp->fixed[j]) qp->x[j] = 0.0;
+  }
+  for (int r = 0; r < m; r++) {
+    double nrm = 0.0;
+    for (int j = 0; j < n; j++) nrm += qp_coef(P, r, j) * qp_coef(P, r, j);
+    qp->scale[r] = nrm > 0.0 ? 1.0 / sqrt(nrm) : 1.0;
+  }
+  for (qp->iterations = 0; qp->iterations < maxit; qp->iterations++) {
+    k = 0;
+    for (int r = 0; r < m; r++) if (inW[r]) W[k++] = r;
+    if (!qp_eqp(P, qp, W, k, D, dvec, b, lam)) return TILT_NUMFAILURE;
+
+    // step towards xs, up to the first blocking bound or row
+    double alpha = 1.0;
+    int block_j = -1, block_r = -1;
+    for (int j = 0; j < n; j++)
+      if (!qp->fixed[j] && qp->xs[j] < 0.0) {
+        double r = qp->x[j] / (qp->x[j] - qp->xs[j]);
+        if (r < alpha) { alpha = r; block_j = j; }
+      }
+    for (int r = 1; r < m; r++) {
+      if (inW[r]) continue;
+      double ax = 0.0, ap = 0.0;
+      for (int j = 0; j < n; j++) {
+        double a = qp_coef(P, r, j);
+        ax += a * qp->x[j];
+        ap += a * (qp->xs[j] - qp->x[j]);
+      }
+      double slack = fmax(ax - b[r], 0.0);
+      if (ap < 0.0 && slack + ap < 0.0 && slack / -ap < alpha) {
+        alpha = slack / -ap;
+        block_r = r;
+        block_j = -1;
+      }
+    }
+    for (int j = 0; j < n; j++) qp->x[j] += alpha * (qp->xs[j] - qp->x[j]);
+    if (block_r >= 0) { inW[block_r] = 1; continue; }
+    if (block_j >= 0) { qp->fixed[block_j] = 1; qp->x[block_j] = 0.0; continue; }
+
+    // at the minimizer over the working set: release the constraint with the most negative multiplier
+    double worst = -tol;
+    int drop_r = -1, drop_j = -1;
+    for (int s = 1; s < k; s++)
+      if (lam[s] < worst) { worst = lam[s]; drop_r = W[s]; }
+    for (int j = 0; j < n; j++) {
+      if (!qp->fixed[j]) continue;
+      double mu = -dvec[j];
+      for (int s = 0; s < k; s++) mu -= lam[s] * qp_coef(P, W[s], j) * qp->scale[W[s]];
+      if (mu < worst) { worst = mu; drop_j = j; drop_r = -1; }
+    }
+    if (drop_j >= 0) qp->fixed[drop_j] = 0;
+    else if (drop_r >= 0) inW[drop_r] = 0;
+    else return TILT_OPTIMAL;
+  }
+  return TILT_SUBOPTIMAL;
+}
+
+
+// the L-MVSKT loop ------------------------------------------------------------------------------------------
+
+typedef struct {
+  int N, nthreads;
+  const double *mu, *Sgm, *d, *w0_moments;
+  hop_comoment Phi, Psi;  // in any storage
+  double *jac;            // 4 x N, as the jacobian in the R implementation
+  double moments[4], obj;
+} tilt_eval;
+
+// moments' gradients, moments, and objective at w
+static void tilt_fun_eval(tilt_eval *e, const double *w) {
+  int N = e->N;
+  double *g2 = e->jac + (R_xlen_t)N;
+  for (int i = 0; i < N; i++) {
+    double s = 0.0;
+    for (int j = 0; j < N; j++) s += e->Sgm[(R_xlen_t)j * N + i] * w[j];
+    e->jac[i] = e->mu[i];
+    g2[i] = 2 * s;
+  }
+  const void *vmax = vmaxget();  // the scratch of the kernels, released at each evaluation
+  hop_port_kernel(&e->Phi, w, N, e->nthreads, e->jac + 2 * (R_xlen_t)N);
+  hop_port_kernel(&e->Psi, w, N, e->nthreads, e->jac + 3 * (R_xlen_t)N);
+  vmaxset(vmax);
+
+  static const double sgn[4] = {1.0, -1.0, 1.0, -1.0};
+  e->obj = R_NegInf;
+  for (int r = 0; r < 4; r++) {
+    double s = 0.0;
+    for (int i = 0; i < N; i++) s += e->jac[(R_xlen_t)r * N + i] * w[i];
+    e->moments[r] = s / (r + 1);
+    e->obj = fmax(e->obj, - (e->moments[r] - e->w0_moments[r]) / e->d[r] * sgn[r]);
+  }
+}
+
+void tilt_run(const double *d, const double *mu, const double *Sgm, const hop_comoment *Phi, const hop_comoment *Psi,
+              int N, const double *w0, const double *w0_moments, const tilt_options *opt, double *w, tilt_trace *tr) {
+  int maxiter = opt->maxiter, split = opt->leverage > 1;
+  double leverage = opt->leverage, kappa = opt->kappa, tau_w = opt->tau_w, tau_delta = opt->tau_delta;
+  double gamma = opt->gamma, zeta = opt->zeta, theta = opt->theta;
+  if (!(tau_w > 0) || !(tau_delta > 0)) error("the native L-MVSKT needs tau_w > 0 and tau_delta > 0.");
+  double start_time = hop_time(), t0 = 0.0, *prof = tr->prof;
+
+  tilt_eval e = {.N = N, .nthreads = opt->nthreads, .mu = mu, .Sgm = Sgm, .d = d, .w0_moments = w0_moments,
+                 .Phi = *Phi, .Psi = *Psi, .jac = (double *) R_alloc(4 * (size_t)N, sizeof(double))};
+
+  int n_w = split ? 2 * N : N, n = n_w + 1, m = split ? 7 : 6;
+  tilt_rows P = {.N = N, .n_w = n_w, .n = n, .m = m, .leverage = leverage,
+                 .A = (double *) R_alloc((size_t)m * n, sizeof(double))};
+  tilt_lp lp = {.ncol = n + 1 + (m - 1), .is_basic = (int *) R_alloc(n + 1 + (m - 1), sizeof(int))};
+  tilt_qp qp = {.x = (double *) R_alloc(n, sizeof(double)), .xs = (double *) R_alloc(n, sizeof(double)),
+                .fixed = (int *) R_alloc(n, sizeof(int))};
+
+  double *F = (double *) R_alloc(5 * ((size_t)N + 1), sizeof(double));
+  double *Sdw = (double *) R_alloc(N, sizeof(double));
+  double *x_lp = (double *) R_alloc(n, sizeof(double));
+  double *x_k = (double *) R_alloc(n, sizeof(double));
+  double *D = (double *) R_alloc(n, sizeof(double));
+  double *dvec = (double *) R_alloc(n, sizeof(double));
+  double *w_old = (double *) R_alloc(N, sizeof(double));
+  double gk[5], rhs[5], b[TLT_MAXROWS];
+  for (int j = 0; j < n; j++) D[j] = (j < P.n_w) ? tau_w : tau_delta;
+
+  double delta = 0.0;
+  if (prof) {
+    memset(prof, 0, sizeof(double) * 4 * ((size_t)maxiter + 1));
+    t0 = hop_time();
+  }
+  tr->cpu_time[0] = 0.0;
+  tilt_fun_eval(&e, w);
+  tr->objs[0] = e.obj;
+  if (prof) prof[0] = hop_time() - t0;
+
+  static const double sgn[4] = {-1.0, 1.0, -1.0, 1.0};
+  int iter;
+  for (iter = 1; iter <= maxiter; iter++) {
+    R_CheckUserInterrupt();
+    memcpy(w_old, w, sizeof(double) * N);
+    if (tr->lp_iter) tr->lp_iter[iter] = tr->lp_warm[iter] = tr->qp_iter[iter] = 0;
+    if (tr->lp_status) tr->lp_status[iter] = TILT_NOT_SOLVED;
+
+    // linearized constraints f.con %*% (w, delta) >= f.rhs - gk at the current point
+    if (prof) t0 = hop_time();
+    double te = 0.0;
+    for (int i = 0; i < N; i++) {
+      double s = 0.0;
+      for (int j = 0; j < N; j++) s += Sgm[(R_xlen_t)j * N + i] * (w[j] - w0[j]);
+      Sdw[i] = s;
+      te += s * (w[i] - w0[i]);
+    }
+    for (int i = 0; i < N; i++) {
+      F[(R_xlen_t)i * 5] = -2 * Sdw[i];
+      for (int r = 0; r < 4; r++) F[(R_xlen_t)i * 5 + r + 1] = -sgn[r] * e.jac[(R_xlen_t)r * N + i];
+    }
+    F[(R_xlen_t)N * 5] = 0.0;
+    for (int r = 0; r < 4; r++) F[(R_xlen_t)N * 5 + r + 1] = -e.d[r];
+    gk[0] = te - kappa * kappa;
+    for (int r = 0; r < 4; r++) gk[r + 1] = (e.moments[r] - e.w0_moments[r]) * sgn[r] + delta * e.d[r];
+    double gmax = R_NegInf;
+    for (int i = 0; i < 5; i++) {
+      double s = F[(R_xlen_t)N * 5 + i] * delta;
+      for (int j = 0; j < N; j++) s += F[(R_xlen_t)j * 5 + i] * w[j];
+      rhs[i] = gk[i] + s;
+      gmax = fmax(gmax, gk[i]);
+    }
+    tilt_rows_set(&P, F);
+    for (int j = 0; j < N; j++) {
+      x_k[j] = split ? fmax(w[j], 0.0) : w[j];
+      if (split) x_k[N + j] = fmax(-w[j], 0.0);
+    }
+    x_k[n - 1] = delta;
+    if (prof) prof[4 * iter + 1] = hop_time() - t0;
+
+    // enlarge the feasible set of the approximating problem by eta, starting the QP from a feasible point
+    if (prof) t0 = hop_time();
+    b[0] = 1.0;
+    if (split) b[6] = leverage;
+    for (int i = 0; i < 5; i++) b[i + 1] = rhs[i];
+    double eta = 0.0;
+    if (gmax <= 0) {
+      memcpy(qp.x, x_k, sizeof(double) * n);
+    } else {
+      double t = lp_solve(&P, &lp, b, w, x_lp);
+      if (tr->lp_iter) {
+        tr->lp_iter[iter] = lp.iterations;
+        tr->lp_warm[iter] = lp.warm;
+      }
+      if (tr->lp_status) tr->lp_status[iter] = lp.status;
+      eta = theta * t + (1 - theta) * gmax;
+      for (int j = 0; j < n; j++) qp.x[j] = theta * x_lp[j] + (1 - theta) * x_k[j];
+    }
+
+    // solve the approximating problem
+    for (int i = 0; i < 5; i++) b[i + 1] = rhs[i] - eta;
+    if (split) b[6] = -leverage;
+    for (int j = 0; j < P.n_w; j++) dvec[j] = tau_w * (j < N ? w[j] : -w[j - N]);
+    dvec[n - 1] = tau_delta * delta + 1;
+    qp.status = qp_solve(&P, &qp, D, dvec, b);
+    if (tr->lp_iter) tr->qp_iter[iter] = qp.iterations;
+    if (tr->qp_status) tr->qp_status[iter] = qp.status;
+    if (prof) {
+      prof[4 * iter + 2] = hop_time() - t0;
+      prof[4 * iter + 3] = 1 + (gmax > 0);
+    }
+
+    // update w
+    for (int i = 0; i < N; i++) {
+      double w_hat = split ? qp.x[i] - qp.x[N + i] : qp.x[i];
+      w[i] += gamma * (w_hat - w[i]);
+    }
+    delta += gamma * (qp.x[n - 1] - delta);
+    gamma = gamma * (1 - zeta * gamma);
+
+    // recording...
+    tr->cpu_time[iter] = hop_time() - start_time;
+    if (prof) t0 = hop_time();
+    tilt_fun_eval(&e, w);
+    if (prof) prof[4 * iter] = hop_time() - t0;
+    tr->objs[iter] = e.obj;
+
+    // termination criterion
+    double dw = 0.0, nw = 0.0;
+    for (int i = 0; i < N; i++) {
+      dw += (w[i] - w_old[i]) * (w[i] - w_old[i]);
+      nw += w_old[i] * w_old[i];
+    }
+    int has_w_converged = sqrt(dw) <= opt->wtol * sqrt(nw);
+    int has_f_converged = fabs(tr->objs[iter] - tr->objs[iter - 1]) <= opt->ftol * fabs(tr->objs[iter]);
+    int has_cross_stopval = tr->objs[iter] <= opt->stopval;
+    if (has_w_converged || has_f_converged || has_cross_stopval) break;
+  }
+  tr->iterations = iter > maxiter ? maxiter : iter;
+  tr->delta = delta;
+  memcpy(tr->moments, e.moments, sizeof(double) * 4);
+}
+
+
+// R interface (left out of the core library, see core/Makefile)
+#ifndef HOP_STANDALONE
+
+SEXP  MVSKtilting_lin(SEXP DD, SEXP MU, SEXP SGM, SEXP PHI, SEXP PSI, SEXP WINIT, SEXP W0, SEXP W0MOM, SEXP PARAMS,
+                      SEXP MAXITER, SEXP NTHREADS, SEXP PROFILE){
+  /*
+   arguments
+   DD        : numeric vector of length 4, the weights d of the moments' improvements
+   MU        : numeric vector of length N, mean
+   SGM       : numeric N x N matrix, covariance
+   PHI, PSI  : coskewness and cokurtosis (in any storage, see hop_comoment)
+   WINIT     : numeric vector of length N, initial portfolio
+   W0        : numeric vector of length N, reference portfolio
+   W0MOM     : numeric vector of length 4, moments of the reference portfolio
+   PARAMS    : numeric vector (leverage, kappa, tau_w, tau_delta, gamma, zeta, theta, ftol, wtol, stopval)
+   MAXITER   : integer, maximum number of iterations
+   NTHREADS  : integer, number of threads (non-positive means OpenMP default)
+   PROFILE   : logical, whether to time the phases of each iteration
+
+   returns a list with the solution w and delta, the elapsed time and objective per iteration, the number
+   of iterations, the moments at the solution, the iterations of the LP and QP solvers and whether the LP
+   started from the previous basis at each iteration, their exit status (codes of lpSolveAPI, -1 if there
+   was no LP) at each iteration, and (if PROFILE) the (iterations + 1) x 4 matrix
+   with the time of the function evaluation, of the assembly of the subproblems, and of their solves, and
+   the number of solves at each iteration (the first row being the initialization)
+   */
+
+  int N = LENGTH(MU), maxiter = asInteger(MAXITER), profile = asLogical(PROFILE) == TRUE;
+  const double *par = REAL(PARAMS);
+  tilt_options opt = {maxiter, hop_num_threads(asInteger(NTHREADS)), par[0], par[1], par[2], par[3], par[4], par[5],
+                      par[6], par[7], par[8], par[9]};
+  hop_comoment Phi = hop_comoment_get(PHI, 3, N), Psi = hop_comoment_get(PSI, 4, N);
+
+  SEXP W = PROTECT(duplicate(WINIT));
+  tilt_trace tr;
+  tr.cpu_time = (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.objs = (double *) R_alloc((size_t)maxiter + 1, sizeof(double));
+  tr.lp_iter = (int *) R_alloc((size_t)maxiter + 1, sizeof(int));
+  tr.lp_warm = (int *) R_alloc((size_t)maxiter + 1, sizeof(int));
+  tr.qp_iter = (int *) R_alloc((size_t)maxiter + 1, sizeof(int));
+  tr.lp_status = (int *) R_alloc((size_t)maxiter + 1, sizeof(int));
+  tr.qp_status = (int *) R_alloc((size_t)maxiter + 1, sizeof(int));
+  tr.prof = profile ? (double *) R_alloc(4 * ((size_t)maxiter + 1), sizeof(double)) : NULL;
+  tilt_run(REAL(DD), REAL(MU), REAL(SGM), &Phi, &Psi, N, REAL(W0), REAL(W0MOM), &opt, REAL(W), &tr);
+  int iter = tr.iterations;
+
+  const char *names[] = {"w", "delta", "cpu_time_vs_iterations", "objfun_vs_iterations", "iterations", "moments",
+                         "solver_iterations", "solver_status", "profile", ""};
+  SEXP res = PROTECT(mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(res, 0, W);
+  SET_VECTOR_ELT(res, 1, ScalarReal(tr.delta));
+  SEXP tm = SET_VECTOR_ELT(res, 2, allocVector(REALSXP, iter + 1));
+  SEXP ob = SET_VECTOR_ELT(res, 3, allocVector(REALSXP, iter + 1));
+  memcpy(REAL(tm), tr.cpu_time, sizeof(double) * (iter + 1));
+  memcpy(REAL(ob), tr.objs, sizeof(double) * (iter + 1));
+  SET_VECTOR_ELT(res, 4, ScalarInteger(iter));
+  SEXP mom = SET_VECTOR_ELT(res, 5, allocVector(REALSXP, 4));
+  memcpy(REAL(mom), tr.moments, sizeof(double) * 4);
+  SEXP si = SET_VECTOR_ELT(res, 6, allocMatrix(INTSXP, iter, 3));
+  for (int k = 0; k < iter; k++) {
+    INTEGER(si)[k] = tr.lp_iter[k + 1];
+    INTEGER(si)[iter + k] = tr.lp_warm[k + 1];
+    INTEGER(si)[2 * iter + k] = tr.qp_iter[k + 1];
+  }
+  SEXP ss = SET_VECTOR_ELT(res, 7, allocMatrix(INTSXP, iter, 2));
+  for (int k = 0; k < iter; k++) {
+    INTEGER(ss)[k] = tr.lp_status[k + 1];
+    INTEGER(ss)[iter + k] = tr.qp_status[k + 1];
+  }
+  if (profile) {
+    SEXP pr = SET_VECTOR_ELT(res, 8, allocMatrix(REALSXP, iter + 1, 4));
+    for (int k = 0; k <= iter; k++)
+      for (int c = 0; c < 4; c++) REAL(pr)[(R_xlen_t)c * (iter + 1) + k] = tr.prof[4 * k + c];
+  }
+
+  UNPROTECT(2);
+  return res;
+}
+
+#endif